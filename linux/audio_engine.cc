@@ -0,0 +1,329 @@
+#include "audio_engine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "dsp_kernels.h"
+
+namespace just_audio_windows_linux {
+
+// Frames each renderer is asked for at a time while mixing.
+static constexpr ma_uint32 kMixBlockFrames = 1024;
+
+// Period lengths the profiles ask for; the backend may round them.
+static constexpr ma_uint32 kLowLatencyPeriodMs = 5;
+static constexpr ma_uint32 kPowerSavingPeriodMs = 100;
+
+/* ---------------- singleton ---------------- */
+
+AudioEngine &AudioEngine::Instance() {
+  static AudioEngine engine;
+  return engine;
+}
+
+AudioEngine::~AudioEngine() {
+  // An Init() still running at exit would otherwise outlive the members.
+  if (warm_up_thread_.joinable()) {
+    warm_up_thread_.join();
+  }
+  if (initialized_) {
+    ma_device_uninit(&device_);
+    ma_context_uninit(&context_);
+  }
+}
+
+/* ---------------- device ---------------- */
+
+void AudioEngine::WarmUp() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!warm_up_thread_.joinable()) {
+    warm_up_thread_ = std::thread([this]() { Init(); });
+  }
+}
+
+bool AudioEngine::Init(LoadTrace *trace) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (initialized_) {
+    return true;
+  }
+
+  // Picks the DSP kernels here rather than on the first callback.
+  Dsp();
+
+  // One backend at a time, so one whose server answers but has no usable
+  // device falls through to the next. The one that worked before goes
+  // first: a reopen after the device was lost does not probe again.
+  std::vector<ma_backend> order;
+  if (has_backend_) {
+    order.push_back(backend_);
+  }
+  for (ma_backend backend : backends_) {
+    if (!has_backend_ || backend != backend_) {
+      order.push_back(backend);
+    }
+  }
+  for (ma_backend backend : order) {
+    if (OpenContext(&backend, 1, trace)) {
+      return true;
+    }
+  }
+  // No list: miniaudio's own probe over every backend compiled in.
+  return backends_.empty() && OpenContext(nullptr, 0, trace);
+}
+
+bool AudioEngine::OpenContext(const ma_backend *backends, ma_uint32 count,
+                              LoadTrace *trace) {
+  {
+    LoadTrace::Scope stage(trace, "contextInit");
+    if (ma_context_init(backends, count, nullptr, &context_) != MA_SUCCESS) {
+      return false;
+    }
+  }
+
+  // Stereo at the device's native rate; tracks at other rates go through a
+  // resampler on their decode thread instead of inside the device.
+  LoadTrace::Scope stage(trace, "deviceInit");
+  if (!OpenDevice(0, 2)) {
+    ma_context_uninit(&context_);
+    return false;
+  }
+
+  backend_ = context_.backend;
+  has_backend_ = true;
+  initialized_ = true;
+  return true;
+}
+
+ma_backend AudioEngine::backend() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return backend_;
+}
+
+void AudioEngine::SetBackends(const std::vector<ma_backend> &backends) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  backends_ = backends;
+}
+
+bool AudioEngine::Reconfigure(ma_uint32 sample_rate, ma_uint32 channels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!initialized_) {
+    return false;
+  }
+  if (sample_rate == sample_rate_ && channels == channels_) {
+    return true;
+  }
+  if (attached_count_ > 0) {
+    return false;
+  }
+  return ReopenDevice(sample_rate, channels);
+}
+
+bool AudioEngine::SetLatency(const OutputLatency &latency) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  bool changed = latency.profile != latency_.profile ||
+                 latency.period_ms != latency_.period_ms;
+  latency_ = latency;
+  if (!initialized_ || !changed) {
+    return true;
+  }
+  if (attached_count_ > 0) {
+    return false;
+  }
+  return ReopenDevice(sample_rate_, channels_);
+}
+
+OutputLatency AudioEngine::latency() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return latency_;
+}
+
+bool AudioEngine::ReopenDevice(ma_uint32 sample_rate, ma_uint32 channels) {
+  ma_uint32 previous_rate = sample_rate_;
+  ma_uint32 previous_channels = channels_;
+  ma_device_uninit(&device_);
+
+  if (OpenDevice(sample_rate, channels)) {
+    return true;
+  }
+  if (!OpenDevice(previous_rate, previous_channels)) {
+    // Nothing left to play through; the next Init() starts over.
+    ma_context_uninit(&context_);
+    initialized_ = false;
+  }
+  return false;
+}
+
+bool AudioEngine::OpenDevice(ma_uint32 sample_rate, ma_uint32 channels) {
+  ma_device_config device_config =
+      ma_device_config_init(ma_device_type_playback);
+  device_config.playback.format = ma_format_f32;
+  device_config.playback.channels = channels;
+  device_config.sampleRate = sample_rate;
+  device_config.dataCallback = AudioEngine::DataCallback;
+  device_config.pUserData = this;
+
+  switch (latency_.profile) {
+  case LatencyProfile::kLowLatency:
+    device_config.performanceProfile = ma_performance_profile_low_latency;
+    device_config.periodSizeInMilliseconds = kLowLatencyPeriodMs;
+    break;
+  case LatencyProfile::kPowerSaving:
+    device_config.performanceProfile = ma_performance_profile_conservative;
+    device_config.periodSizeInMilliseconds = kPowerSavingPeriodMs;
+    break;
+  case LatencyProfile::kDefault:
+    break;
+  }
+  if (latency_.period_ms != 0) {
+    device_config.periodSizeInMilliseconds = latency_.period_ms;
+  }
+
+  if (ma_device_init(&context_, &device_config, &device_) != MA_SUCCESS) {
+    return false;
+  }
+
+  sample_rate_ = device_.sampleRate;
+  channels_ = device_.playback.channels;
+  mix_buffer_.assign((size_t)kMixBlockFrames * channels_, 0.0f);
+  // Figures from another period size would only blur the new ones.
+  callback_stats_.reset();
+  return true;
+}
+
+bool AudioEngine::device_resampling() const {
+  return initialized_ && device_.playback.internalSampleRate != sample_rate_;
+}
+
+bool AudioEngine::device_remixing() const {
+  return initialized_ && device_.playback.internalChannels != channels_;
+}
+
+bool AudioEngine::device_converting_format() const {
+  return initialized_ && device_.playback.internalFormat != ma_format_f32;
+}
+
+ma_uint32 AudioEngine::period_frames() const {
+  return initialized_ ? device_.playback.internalPeriodSizeInFrames : 0;
+}
+
+ma_uint32 AudioEngine::periods() const {
+  return initialized_ ? device_.playback.internalPeriods : 0;
+}
+
+ma_uint32 AudioEngine::internal_sample_rate() const {
+  return initialized_ ? device_.playback.internalSampleRate : 0;
+}
+
+int64_t AudioEngine::latency_us() const {
+  ma_uint32 rate = internal_sample_rate();
+  if (rate == 0) {
+    return 0;
+  }
+  return (int64_t)period_frames() * periods() * 1000000 / rate;
+}
+
+bool AudioEngine::Attach(AudioRenderer *renderer) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!initialized_) {
+    return false;
+  }
+
+  std::atomic<AudioRenderer *> *free_slot = nullptr;
+  for (std::atomic<AudioRenderer *> &slot : renderers_) {
+    AudioRenderer *current = slot.load();
+    if (current == renderer) {
+      return true;
+    }
+    if (current == nullptr && free_slot == nullptr) {
+      free_slot = &slot;
+    }
+  }
+  if (free_slot == nullptr) {
+    return false;
+  }
+
+  free_slot->store(renderer);
+  ++attached_count_;
+  if (!ma_device_is_started(&device_)) {
+    ma_device_start(&device_);
+  }
+  return true;
+}
+
+void AudioEngine::Detach(AudioRenderer *renderer) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!initialized_) {
+    return;
+  }
+
+  bool found = false;
+  for (std::atomic<AudioRenderer *> &slot : renderers_) {
+    AudioRenderer *expected = renderer;
+    if (slot.compare_exchange_strong(expected, nullptr)) {
+      found = true;
+      break;
+    }
+  }
+  if (!found) {
+    return;
+  }
+
+  // The callback may have picked the renderer up just before the swap; wait
+  // until it has left Render().
+  while (in_callback_.load()) {
+    std::this_thread::yield();
+  }
+
+  if (--attached_count_ == 0) {
+    ma_device_stop(&device_);
+  }
+}
+
+/* ---------------- miniaudio callback ---------------- */
+
+void AudioEngine::DataCallback(ma_device *device, void *output, const void *,
+                               ma_uint32 frameCount) {
+  auto start = std::chrono::steady_clock::now();
+  auto *self = static_cast<AudioEngine *>(device->pUserData);
+  const DspKernels &dsp = Dsp();
+  ma_uint32 channels = device->playback.channels;
+  float *mix = self->mix_buffer_.data();
+
+  self->in_callback_.store(true);
+
+  // The first renderer writes straight into the (silenced) output; the rest
+  // render into mix_buffer_ and are added on top.
+  for (ma_uint32 done = 0; done < frameCount;) {
+    ma_uint32 frames = std::min(frameCount - done, kMixBlockFrames);
+    float *out = static_cast<float *>(output) + (size_t)done * channels;
+    size_t samples = (size_t)frames * channels;
+
+    bool first = true;
+    for (std::atomic<AudioRenderer *> &slot : self->renderers_) {
+      AudioRenderer *renderer = slot.load();
+      if (renderer == nullptr) {
+        continue;
+      }
+      if (first) {
+        renderer->Render(out, frames);
+        first = false;
+        continue;
+      }
+      dsp.clear(mix, samples);
+      renderer->Render(mix, frames);
+      dsp.mix_add(out, mix, samples, 1.0f);
+    }
+    done += frames;
+  }
+
+  self->in_callback_.store(false);
+
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start);
+  self->callback_stats_.record(
+      (uint64_t)elapsed.count(),
+      (uint64_t)frameCount * 1000000000 / device->sampleRate);
+}
+
+} // namespace just_audio_windows_linux
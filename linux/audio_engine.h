@@ -0,0 +1,163 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "callback_stats.h"
+#include "load_trace.h"
+#include "miniaudio.h"
+
+namespace just_audio_windows_linux {
+
+/* ---------------- AudioRenderer ---------------- */
+
+// Anything the engine can pull audio from. Render() runs on the real-time
+// device thread and must not block, allocate or call into GLib.
+class AudioRenderer {
+public:
+  virtual ~AudioRenderer() = default;
+
+  // output holds frameCount interleaved f32 frames in the engine's format and
+  // is already silenced.
+  virtual void Render(float *output, ma_uint32 frameCount) = 0;
+};
+
+/* ---------------- OutputLatency ---------------- */
+
+// Trade-off between reaction time and wakeups for the shared device.
+enum class LatencyProfile {
+  // Whatever the backend picks.
+  kDefault,
+  // Short periods, for interactive sounds.
+  kLowLatency,
+  // Long periods, for background music; fewer wakeups.
+  kPowerSaving,
+};
+
+struct OutputLatency {
+  LatencyProfile profile = LatencyProfile::kDefault;
+  // Period length overriding the profile's; 0 keeps it.
+  ma_uint32 period_ms = 0;
+};
+
+/* ---------------- AudioEngine ---------------- */
+
+// Process-wide owner of the miniaudio context and the playback device. Both
+// are opened once and reused for every track; players only attach and detach
+// their renderer. Every attached renderer is summed into the one device.
+class AudioEngine {
+public:
+  static AudioEngine &Instance();
+
+  // Opens the context and device on first use. Safe from any thread. trace,
+  // if given, gets how long each took.
+  bool Init(LoadTrace *trace = nullptr);
+  // Runs Init() on a thread of the engine's own, so the device is ready by
+  // the first load. The engine joins it before closing anything at exit.
+  // Only the first call starts it.
+  void WarmUp();
+
+  // Backends the context tries, in order; empty (the default) lets
+  // miniaudio probe all of them. Only affects an Init() that has not
+  // happened yet.
+  void SetBackends(const std::vector<ma_backend> &backends);
+  // The backend the device opened on. Kept for the life of the process:
+  // should the context ever have to be opened again, it is tried first.
+  ma_backend backend() const;
+
+  // Reopens the device for f32 at sample_rate and channels, for playing a
+  // source without converting it. Refused while any renderer is attached,
+  // since they all render in the current format. On failure the previous
+  // device is restored and false returned.
+  bool Reconfigure(ma_uint32 sample_rate, ma_uint32 channels);
+
+  // Sets the period size and performance profile the device is opened
+  // with. Before Init() it only takes note; after, the device is reopened
+  // right away unless a renderer is attached, in which case it applies from
+  // the next reopen and false is returned.
+  bool SetLatency(const OutputLatency &latency);
+  OutputLatency latency() const;
+
+  // Output format of the device. Only valid after Init() succeeded.
+  ma_uint32 sample_rate() const { return sample_rate_; }
+  ma_uint32 channels() const { return channels_; }
+
+  // Whether miniaudio converts between that format and what the backend
+  // actually runs at. Same thread as Reconfigure().
+  bool device_resampling() const;
+  bool device_remixing() const;
+  bool device_converting_format() const;
+
+  // What the backend actually granted: period size and count, in frames at
+  // internal_sample_rate(), and the total buffering they add up to.
+  ma_uint32 period_frames() const;
+  ma_uint32 periods() const;
+  ma_uint32 internal_sample_rate() const;
+  int64_t latency_us() const;
+
+  // How long the device callback has been taking since the device was last
+  // opened. Any thread.
+  CallbackStats::Snapshot callback_stats() const {
+    return callback_stats_.snapshot();
+  }
+
+  // Most renderers mixed at once.
+  static constexpr size_t kMaxRenderers = 64;
+
+  // Starts pulling from renderer. The device runs while any is attached.
+  // False if the engine is not open or kMaxRenderers are already attached.
+  bool Attach(AudioRenderer *renderer);
+
+  // Stops pulling from renderer; on return the device thread is no longer
+  // inside its Render().
+  void Detach(AudioRenderer *renderer);
+
+private:
+  AudioEngine() = default;
+  ~AudioEngine();
+
+  // Opens the context on the given backends (all of them for none) and the
+  // device on it. Caller holds mutex_.
+  bool OpenContext(const ma_backend *backends, ma_uint32 count,
+                   LoadTrace *trace);
+  // Caller holds mutex_.
+  bool OpenDevice(ma_uint32 sample_rate, ma_uint32 channels);
+  // Closes the device and opens it at the given format with the current
+  // latency_, falling back to the previous format. Caller holds mutex_ and
+  // has checked nothing is attached.
+  bool ReopenDevice(ma_uint32 sample_rate, ma_uint32 channels);
+
+  static void DataCallback(ma_device *device, void *output, const void *input,
+                           ma_uint32 frameCount);
+
+  mutable std::mutex mutex_;
+  bool initialized_ = false;
+  // Started by WarmUp(), guarded by mutex_ until the destructor joins it.
+  std::thread warm_up_thread_;
+  std::vector<ma_backend> backends_;
+  ma_backend backend_ = ma_backend_null;
+  bool has_backend_ = false;
+  OutputLatency latency_;
+  ma_context context_;
+  ma_device device_;
+  // Read without mutex_ by loader threads while Reconfigure() may run.
+  std::atomic<ma_uint32> sample_rate_{0};
+  std::atomic<ma_uint32> channels_{0};
+
+  // Slots the callback scans; attach and detach only fill and clear them
+  // under mutex_. attached_count_ is guarded by mutex_.
+  std::atomic<AudioRenderer *> renderers_[kMaxRenderers] = {};
+  size_t attached_count_ = 0;
+  std::atomic<bool> in_callback_{false};
+  CallbackStats callback_stats_;
+
+  // Where the second and later renderers render before being summed in.
+  // Sized in OpenDevice(); the callback works through longer periods in
+  // pieces.
+  std::vector<float> mix_buffer_;
+};
+
+} // namespace just_audio_windows_linux
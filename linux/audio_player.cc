@@ -3,9 +3,15 @@
 
 #include "miniaudio_libopus.c"
 #include "miniaudio_libvorbis.c"
+#include "miniaudio_mp3_seek.c"
 
+#include <glib-unix.h>
+
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <iostream>
+#include <limits>
 
 namespace just_audio_windows_linux {
 
@@ -40,65 +46,248 @@ std::string decodeURL(const std::string &encoded) {
   return bytes;
 }
 
-static FlEventChannel *event_channel = nullptr;
-static FlEventChannel *data_channel = nullptr;
-
 static gboolean send_playback_event_cb(gpointer user_data) {
   AudioPlayer *player = (AudioPlayer *)user_data;
+  player->SendPlaybackEvent(player->state_.load(), player->position(),
+                            player->duration(), player->current_index_);
+  return G_SOURCE_REMOVE;
+}
 
-  FlValue *map = fl_value_new_map();
-
-  fl_value_set_string(map, "processingState",
-                      fl_value_new_int((int)player->state_));
-
-  fl_value_set_string(map, "updatePosition",
-                      fl_value_new_int(player->position()));
-
-  fl_value_set_string(map, "bufferedPosition",
-                      fl_value_new_int(player->duration_));
+static gboolean drain_rt_events_cb(gint, GIOCondition, gpointer user_data) {
+  static_cast<AudioPlayer *>(user_data)->DrainRtEvents();
+  return G_SOURCE_CONTINUE;
+}
 
-  fl_value_set_string(map, "duration", fl_value_new_int(player->duration_));
+static gboolean poll_rt_events_cb(gpointer user_data) {
+  static_cast<AudioPlayer *>(user_data)->DrainRtEvents();
+  return G_SOURCE_CONTINUE;
+}
 
-  gint64 now_ms = g_get_real_time() / 1000;
-  fl_value_set_string(map, "updateTime", fl_value_new_int(now_ms));
+static gboolean send_playback_data_cb(gpointer user_data) {
+  static_cast<AudioPlayer *>(user_data)->SendPlaybackData();
+  return G_SOURCE_REMOVE;
+}
 
-  fl_value_set_string(map, "currentIndex", fl_value_new_int(0));
+static FlValue *lookup_map(FlValue *map, const char *key) {
+  if (map == nullptr || fl_value_get_type(map) != FL_VALUE_TYPE_MAP) {
+    return nullptr;
+  }
+  return fl_value_lookup_string(map, key);
+}
 
-  fl_event_channel_send(event_channel, map, NULL, NULL);
+// Flattens an audio source message into the uris it plays, in order. A
+// concatenating source contributes its children, anything else its uri.
+static void collect_uris(FlValue *source, std::vector<std::string> *uris) {
+  FlValue *children = lookup_map(source, "children");
+  if (children != nullptr &&
+      fl_value_get_type(children) == FL_VALUE_TYPE_LIST) {
+    for (size_t i = 0; i < fl_value_get_length(children); ++i) {
+      collect_uris(fl_value_get_list_value(children, i), uris);
+    }
+    return;
+  }
 
-  return G_SOURCE_REMOVE;
+  FlValue *uri = lookup_map(source, "uri");
+  if (uri != nullptr && fl_value_get_type(uri) == FL_VALUE_TYPE_STRING) {
+    uris->push_back(fl_value_get_string(uri));
+  }
 }
 
-static gboolean send_playback_data_cb(gpointer user_data) {
-  AudioPlayer *player = (AudioPlayer *)user_data;
+/* ---------------- decode-ahead ring ---------------- */
+
+// Frames per ring block. Small enough that a block decodes well inside one
+// device period, large enough to amortise the per-block bookkeeping.
+static constexpr ma_uint32 kRingBlockFrames = 512;
+
+// Length of the ramps either side of a seek, enough to avoid a click.
+static constexpr ma_uint32 kSeekFadeFrames = 256;
+
+// Least time between two buffered position updates from the decode thread.
+static constexpr auto kBufferedUpdateInterval = std::chrono::milliseconds(250);
+
+// Speeds setSpeed() accepts; beyond them WSOLA output degrades badly.
+static constexpr double kMinSpeed = 0.25;
+static constexpr double kMaxSpeed = 4.0;
+
+// How often audio thread events are collected when there is no eventfd to
+// wait on.
+static constexpr guint kRtEventPollMs = 10;
+
+/* ---------------- background load ---------------- */
+
+// Everything the loader thread produces for one playlist item. Ownership
+// moves to the player when the job is committed on the main thread.
+struct LoadJob {
+  ma_uint64 generation = 0;
+  int index = 0;
+  std::string path;
+  ma_uint64 start_frame = 0;
+  int64_t start_position = 0;
+  FlMethodCall *method_call = nullptr;
+
+  // Prerolls open the item after the one playing and never touch the ring.
+  bool preroll = false;
+  // Refines measure the exact duration of an item already playing with an
+  // estimated one, and build the seek index of an MP3 that has none yet.
+  // They outlive seeks and index changes.
+  bool refine = false;
+
+  // Stages so far; queued_at and finished_at bracket the wait for the
+  // loader thread and for the main loop.
+  LoadTrace trace;
+  LoadTrace::Clock::time_point queued_at = LoadTrace::Clock::now();
+  LoadTrace::Clock::time_point finished_at;
+
+  std::unique_ptr<Track> track;
+  int64_t duration = 0;
+  bool duration_exact = false;
+  std::shared_ptr<const Mp3SeekIndex> seek_index;
+  bool succeeded = false;
+  // None of the configured backends gave us an output device.
+  bool no_output = false;
+
+  ~LoadJob() {
+    if (method_call != nullptr) {
+      g_object_unref(method_call);
+    }
+  }
+};
+
+struct LoadCommit {
+  std::weak_ptr<bool> alive;
+  AudioPlayer *player;
+  std::unique_ptr<LoadJob> job;
+};
+
+struct BufferedNotice {
+  std::weak_ptr<bool> alive;
+  AudioPlayer *player;
+};
+
+static void respond_load_aborted(FlMethodCall *method_call) {
+  if (method_call != nullptr) {
+    fl_method_call_respond_error(method_call, "abort", "Loading interrupted",
+                                 nullptr, nullptr);
+  }
+}
 
+// Which format conversions the item just loaded goes through on its way to
+// the speakers: in its decoder, in its resampler, or inside the device.
+static FlValue *conversion_report(const Track &track,
+                                  const AudioEngine &engine) {
   FlValue *map = fl_value_new_map();
+  fl_value_set_string_take(map, "sourceSampleRate",
+                           fl_value_new_int(track.sample_rate()));
+  fl_value_set_string_take(map, "outputSampleRate",
+                           fl_value_new_int(engine.sample_rate()));
+  fl_value_set_string_take(map, "outputChannels",
+                           fl_value_new_int(engine.channels()));
+  fl_value_set_string_take(map, "decoderChannelMix",
+                           fl_value_new_bool(track.remixing()));
+  fl_value_set_string_take(map, "resample",
+                           fl_value_new_bool(track.resampling()));
+  fl_value_set_string_take(map, "deviceResample",
+                           fl_value_new_bool(engine.device_resampling()));
+  fl_value_set_string_take(map, "deviceChannelMix",
+                           fl_value_new_bool(engine.device_remixing()));
+  fl_value_set_string_take(
+      map, "deviceFormatConversion",
+      fl_value_new_bool(engine.device_converting_format()));
+  return map;
+}
 
-  fl_value_set_string(map, "playing", fl_value_new_bool(player->playing_));
-
-  fl_value_set_string(map, "volume", fl_value_new_float(player->volume_));
+// What the device buffers, as the backend granted it.
+static FlValue *latency_report(const AudioEngine &engine) {
+  static const char *const kProfileNames[] = {"default", "lowLatency",
+                                              "powerSaving"};
+  FlValue *map = fl_value_new_map();
+  fl_value_set_string_take(
+      map, "profile",
+      fl_value_new_string(kProfileNames[(int)engine.latency().profile]));
+  fl_value_set_string_take(map, "periodFrames",
+                           fl_value_new_int(engine.period_frames()));
+  fl_value_set_string_take(map, "periods",
+                           fl_value_new_int(engine.periods()));
+  fl_value_set_string_take(map, "deviceSampleRate",
+                           fl_value_new_int(engine.internal_sample_rate()));
+  fl_value_set_string_take(map, "latencyUs",
+                           fl_value_new_int(engine.latency_us()));
+  fl_value_set_string_take(
+      map, "backend",
+      fl_value_new_string(ma_get_backend_name(engine.backend())));
+  return map;
+}
 
-  fl_value_set_string(map, "speed", fl_value_new_float(1.0));
+// Microseconds spent in each stage of a load, summed where a stage ran more
+// than once, and in the whole load up to `end`.
+static FlValue *timing_report(const LoadTrace &trace,
+                              LoadTrace::Clock::time_point end) {
+  auto us = [](LoadTrace::Clock::duration elapsed) {
+    return (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+               elapsed)
+        .count();
+  };
 
-  fl_value_set_string(map, "loopMode", fl_value_new_int(0));
+  FlValue *map = fl_value_new_map();
+  for (const LoadTrace::Span &span : trace.spans()) {
+    FlValue *sum = fl_value_lookup_string(map, span.name);
+    int64_t total = us(span.end - span.start) +
+                    (sum != nullptr ? fl_value_get_int(sum) : 0);
+    fl_value_set_string_take(map, span.name, fl_value_new_int(total));
+  }
+  fl_value_set_string_take(map, "total",
+                           fl_value_new_int(us(end - trace.begin())));
+  return map;
+}
 
-  fl_value_set_string(map, "shuffleMode", fl_value_new_int(0));
+static gboolean commit_load_cb(gpointer user_data) {
+  auto *commit = static_cast<LoadCommit *>(user_data);
+  if (commit->alive.expired()) {
+    respond_load_aborted(commit->job->method_call);
+  } else {
+    commit->player->CommitLoad(std::move(commit->job));
+  }
+  return G_SOURCE_REMOVE;
+}
 
-  fl_event_channel_send(data_channel, map, NULL, NULL);
+static void free_load_commit(gpointer user_data) {
+  delete static_cast<LoadCommit *>(user_data);
+}
 
+static gboolean buffered_notice_cb(gpointer user_data) {
+  auto *notice = static_cast<BufferedNotice *>(user_data);
+  if (!notice->alive.expired()) {
+    AudioPlayer *player = notice->player;
+    player->SendPlaybackEvent(player->state_.load(), player->position(),
+                              player->duration(), player->current_index_);
+  }
   return G_SOURCE_REMOVE;
 }
 
-static FlValue *lookup_map(FlValue *map, const char *key) {
-  if (map == nullptr || fl_value_get_type(map) != FL_VALUE_TYPE_MAP) {
-    return nullptr;
-  }
-  return fl_value_lookup_string(map, key);
+static void free_buffered_notice(gpointer user_data) {
+  delete static_cast<BufferedNotice *>(user_data);
 }
 
 /* ---------------- ctor / dtor ---------------- */
 
-AudioPlayer::AudioPlayer(const std::string &id, FlBinaryMessenger *messenger) {
+AudioPlayer::AudioPlayer(const std::string &id, FlBinaryMessenger *messenger,
+                         const AudioPlayerOptions &options)
+    : id_(id), options_(options),
+      // Update times only mean something next to a position; on their own
+      // they are not worth a diff.
+      event_encoder_(options.event_encoding,
+                     {{"processingState", FL_VALUE_TYPE_INT},
+                      {"updatePosition", FL_VALUE_TYPE_INT},
+                      {"bufferedPosition", FL_VALUE_TYPE_INT},
+                      {"duration", FL_VALUE_TYPE_INT},
+                      {"updateTime", FL_VALUE_TYPE_INT, true},
+                      {"currentIndex", FL_VALUE_TYPE_INT}}),
+      data_encoder_(options.event_encoding,
+                    {{"playing", FL_VALUE_TYPE_BOOL},
+                     {"volume", FL_VALUE_TYPE_FLOAT},
+                     {"speed", FL_VALUE_TYPE_FLOAT},
+                     {"loopMode", FL_VALUE_TYPE_INT},
+                     {"shuffleMode", FL_VALUE_TYPE_INT}}) {
 
   /* -------- method channel -------- */
   player_channel_ = fl_method_channel_new(
@@ -113,14 +302,31 @@ AudioPlayer::AudioPlayer(const std::string &id, FlBinaryMessenger *messenger) {
       this, nullptr);
 
   /* -------- event channel -------- */
-  event_channel = fl_event_channel_new(
+  event_channel_ = fl_event_channel_new(
       messenger, ("com.ryanheise.just_audio.events." + id).c_str(),
       FL_METHOD_CODEC(fl_standard_method_codec_new()));
 
   /* -------- data channel -------- */
-  data_channel = fl_event_channel_new(
+  data_channel_ = fl_event_channel_new(
       messenger, ("com.ryanheise.just_audio.data." + id).c_str(),
       FL_METHOD_CODEC(fl_standard_method_codec_new()));
+
+  /* -------- audio thread events -------- */
+  // Without an eventfd the queue is polled instead, at a rate that is still
+  // well inside what the UI notices.
+  if (rt_events_.fd() >= 0) {
+    rt_event_source_ = g_unix_fd_source_new(rt_events_.fd(), G_IO_IN);
+    g_source_set_callback(rt_event_source_,
+                          G_SOURCE_FUNC(drain_rt_events_cb), this, nullptr);
+  } else {
+    rt_event_source_ = g_timeout_source_new(kRtEventPollMs);
+    g_source_set_callback(rt_event_source_, poll_rt_events_cb, this, nullptr);
+  }
+  g_source_attach(rt_event_source_, nullptr);
+
+  /* -------- worker threads -------- */
+  decode_thread_ = std::thread(&AudioPlayer::DecodeLoop, this);
+  load_thread_ = std::thread(&AudioPlayer::LoadLoop, this);
 }
 
 AudioPlayer::~AudioPlayer() {
@@ -129,175 +335,1102 @@ AudioPlayer::~AudioPlayer() {
                                               nullptr);
   }
 
-  if (initialized_) {
-    ma_device_uninit(&device_);
-    ma_decoder_uninit(&decoder_);
+  // Loads still queued on the main loop see this and abort.
+  alive_.reset();
+
+  {
+    std::lock_guard<std::mutex> lock(load_mutex_);
+    load_quit_ = true;
+    if (pending_load_) {
+      respond_load_aborted(pending_load_->method_call);
+      pending_load_.reset();
+    }
+  }
+  load_cv_.notify_one();
+  load_thread_.join();
+
+  if (attached_) {
+    AudioEngine::Instance().Detach(this);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(decoder_mutex_);
+    decode_quit_ = true;
+  }
+  decode_cv_.notify_one();
+  decode_thread_.join();
+
+  // The callback is detached, so nothing pushes any more.
+  g_source_destroy(rt_event_source_);
+  g_source_unref(rt_event_source_);
+
+  g_object_unref(event_channel_);
+  g_object_unref(data_channel_);
+  g_object_unref(player_channel_);
+  if (load_timing_ != nullptr) {
+    fl_value_unref(load_timing_);
   }
 }
 
 /* ---------------- audio control ---------------- */
 
-bool AudioPlayer::load(const std::string &uri) {
-  current_frame_ = 0;
+void AudioPlayer::load(const std::vector<std::string> &uris, int index,
+                       int64_t positionMs, FlMethodCall *method_call) {
+  LoadTrace trace;
+  {
+    LoadTrace::Scope stage(&trace, "uriDecode");
+    std::lock_guard<std::mutex> lock(load_mutex_);
+    playlist_.clear();
+    for (const std::string &uri : uris) {
+      playlist_.push_back(decodeURL(uri.substr(7)));
+    }
+    refine_jobs_.clear();
+  }
+  items_.assign(uris.size(), ItemInfo());
+
+  StartLoad(index, positionMs, method_call, std::move(trace));
+}
+
+// Opens playlist item `index` in place of whatever is playing.
+void AudioPlayer::StartLoad(int index, int64_t positionMs,
+                            FlMethodCall *method_call, LoadTrace trace) {
   state_ = PlayerState::LOADING;
   sendPlaybackEvent();
 
-  std::string path = uri;
-  path = path.substr(7);
-  path = decodeURL(path);
+  auto job = std::make_unique<LoadJob>();
+  job->trace = std::move(trace);
+  job->generation = ++load_generation_;
+  job->index = index;
+  job->start_position = positionMs;
+  if (method_call != nullptr) {
+    job->method_call = FL_METHOD_CALL(g_object_ref(method_call));
+  }
 
-  if (initialized_) {
-    ma_device_stop(&device_);
-    ma_device_uninit(&device_);
-    ma_decoder_uninit(&decoder_);
-    ma_context_uninit(&context_);
-    initialized_ = false;
+  std::lock_guard<std::mutex> lock(load_mutex_);
+  job->path = playlist_[index];
+  if (pending_load_) {
+    respond_load_aborted(pending_load_->method_call);
   }
+  pending_load_ = std::move(job);
+  load_cv_.notify_one();
+}
 
-  if (ma_context_init(nullptr, 0, nullptr, &context_) != MA_SUCCESS) {
-    state_ = PlayerState::READY;
-    sendPlaybackEvent();
+// Queues item `index` to be opened behind the one being decoded. Called from
+// the main thread and the decode thread. It waits behind a pending load
+// rather than being dropped, since the decode thread holds back the end of
+// the current item until it arrives; a newer preroll replaces it.
+void AudioPlayer::RequestPreroll(int index) {
+  std::lock_guard<std::mutex> lock(load_mutex_);
+  if (index >= (int)playlist_.size()) {
+    return;
+  }
 
-    return false;
+  auto job = std::make_unique<LoadJob>();
+  job->generation = load_generation_;
+  job->index = index;
+  job->path = playlist_[index];
+  job->preroll = true;
+  preroll_load_ = std::move(job);
+  load_cv_.notify_one();
+}
+
+// Queues a full-length measurement of item `index`, whose duration so far
+// is an estimate from its headers. Main thread only.
+void AudioPlayer::RequestRefine(int index) {
+  if (items_[index].refining) {
+    return;
+  }
+  items_[index].refining = true;
+
+  auto job = std::make_unique<LoadJob>();
+  job->index = index;
+  job->refine = true;
+
+  std::lock_guard<std::mutex> lock(load_mutex_);
+  job->path = playlist_[index];
+  refine_jobs_.push_back(std::move(job));
+  load_cv_.notify_one();
+}
+
+void AudioPlayer::LoadLoop() {
+  std::unique_lock<std::mutex> lock(load_mutex_);
+
+  while (!load_quit_) {
+    std::unique_ptr<LoadJob> job;
+    if (pending_load_) {
+      job = std::move(pending_load_);
+    } else if (preroll_load_) {
+      job = std::move(preroll_load_);
+    } else if (!refine_jobs_.empty()) {
+      job = std::move(refine_jobs_.front());
+      refine_jobs_.pop_front();
+    } else {
+      load_cv_.wait(lock);
+      continue;
+    }
+    lock.unlock();
+
+    job->trace.Add("queued", job->queued_at, LoadTrace::Clock::now());
+    RunLoadJob(job.get());
+    job->finished_at = LoadTrace::Clock::now();
+
+    // Hand the result to the main thread even when superseded, so the method
+    // call is always answered from there.
+    auto *commit = new LoadCommit{load_alive_, this, std::move(job)};
+    g_main_context_invoke_full(nullptr, G_PRIORITY_DEFAULT, commit_load_cb,
+                               commit, free_load_commit);
+
+    lock.lock();
+  }
+}
+
+void AudioPlayer::RunLoadJob(LoadJob *job) {
+  auto superseded = [&]() { return job->generation != load_generation_; };
+
+  // Only opens anything on the very first load of the process.
+  AudioEngine &engine = AudioEngine::Instance();
+  if (!engine.Init(&job->trace)) {
+    job->no_output = true;
+    return;
+  }
+
+  if (superseded() && !job->refine) {
+    return;
+  }
+
+  // A preroll has to match the device the item before it is playing on.
+  if (options_.native_output && !job->preroll && !job->refine) {
+    job->track = Track::Open(job->path, 0, 0, &job->trace);
+  } else {
+    job->track = Track::Open(job->path, engine.channels(),
+                             engine.sample_rate(), &job->trace);
+  }
+  if (!job->track) {
+    return;
+  }
+
+  ma_uint32 sample_rate = job->track->sample_rate();
+  if (job->refine) {
+    LoadTrace::Scope stage(&job->trace, "lengthScan");
+    ma_uint64 frames = 0;
+    if (job->track->wants_seek_index()) {
+      job->seek_index = Mp3SeekIndex::Build(*job->track->file());
+    }
+    if (job->seek_index != nullptr) {
+      job->seek_index->Save(*job->track->file());
+      frames = job->seek_index->total_frames();
+    } else {
+      frames = job->track->LengthInFrames();
+    }
+    job->duration = (frames * 1000000) / sample_rate;
+    job->duration_exact = true;
+    job->track.reset();
+    job->succeeded = true;
+    return;
   }
 
-  ma_decoder_config decoder_config =
-      ma_decoder_config_init(ma_format_f32, 2, 44100);
+  if (superseded()) {
+    return;
+  }
+
+  // Headers are enough to report READY; a refine job replaces the figure
+  // later if the track could not say for certain.
+  bool exact = false;
+  ma_uint64 frames = job->track->EstimatedLengthInFrames(&exact);
+  job->duration = (frames * 1000000) / sample_rate;
+  job->duration_exact = exact;
+
+  if (job->start_position > 0) {
+    LoadTrace::Scope stage(&job->trace, "startSeek");
+    job->start_frame = job->start_position * (int64_t)sample_rate / 1000000;
+    job->track->Seek(job->start_frame);
+  }
+
+  if (job->preroll) {
+    LoadTrace::Scope stage(&job->trace, "preroll");
+    job->track->Preroll();
+  }
+  job->succeeded = true;
+}
+
+void AudioPlayer::CommitLoad(std::unique_ptr<LoadJob> job) {
+  job->trace.Add("mainLoopWait", job->finished_at, LoadTrace::Clock::now());
+
+  if (job->refine) {
+    ExportTrace(*job, job->succeeded ? "" : " (failed)");
+    CommitRefine(std::move(job));
+    return;
+  }
 
-  if (ma_decoder_init_file(path.c_str(), &decoder_config, &decoder_) !=
-      MA_SUCCESS) {
-    decoder_config = ma_decoder_config_init_default();
+  if (job->generation != load_generation_) {
+    ExportTrace(*job, " (superseded)");
+    respond_load_aborted(job->method_call);
+    // The decode thread may still be waiting on this item, e.g. when the
+    // load that superseded it failed; open it again from the current list.
+    if (job->preroll) {
+      bool waiting;
+      {
+        std::lock_guard<std::mutex> lock(decoder_mutex_);
+        waiting = job->index == preroll_index_;
+      }
+      if (waiting) {
+        RequestPreroll(job->index);
+      }
+    }
+    return;
+  }
 
-    ma_decoding_backend_vtable *pCustomBackendVTables[] = {
-        ma_decoding_backend_libopus, ma_decoding_backend_libvorbis};
-    decoder_config.pCustomBackendUserData = NULL;
-    decoder_config.ppCustomBackendVTables = pCustomBackendVTables;
-    decoder_config.customBackendCount =
-        sizeof(pCustomBackendVTables) / sizeof(pCustomBackendVTables[0]);
+  if (job->succeeded) {
+    ItemInfo &item = items_[job->index];
+    // A reopened item keeps a duration that was already measured.
+    if (job->duration_exact || !item.duration_exact) {
+      item.duration = job->duration;
+      item.duration_exact = job->duration_exact;
+    }
+    item.sample_rate = job->track->sample_rate();
 
-    if (ma_decoder_init_file(path.c_str(), &decoder_config, &decoder_) !=
-        MA_SUCCESS) {
-      ma_decoder_uninit(&decoder_);
-      ma_context_uninit(&context_);
+    // An index built earlier this session covers sidecars that could not
+    // be written.
+    if (item.seek_index != nullptr) {
+      job->track->BindSeekIndex(item.seek_index);
+    }
+    if (!item.duration_exact || job->track->wants_seek_index()) {
+      RequestRefine(job->index);
+    }
+  }
 
-      state_ = PlayerState::READY;
-      sendPlaybackEvent();
+  if (job->preroll) {
+    int retry_index = -1;
+    {
+      std::lock_guard<std::mutex> lock(decoder_mutex_);
+      if (job->index == preroll_index_) {
+        if (job->succeeded &&
+            (job->track->channels() != ring_.channels() ||
+             job->track->output_rate() != output_rate_)) {
+          // Opened after another player changed the device format; play()
+          // reloads this player before it is heard again.
+          preroll_index_ = -1;
+        } else if (job->succeeded) {
+          next_track_ = std::move(job->track);
+          next_index_ = job->index;
+          preroll_index_ = -1;
+        } else {
+          // An unreadable item is skipped in favour of the one after it.
+          preroll_index_ = job->index + 1 < item_count_ ? job->index + 1 : -1;
+          retry_index = preroll_index_;
+        }
+      }
+    }
+    decode_cv_.notify_one();
 
-      return false;
+    ExportTrace(*job, job->succeeded ? "" : " (failed)");
+    if (retry_index >= 0) {
+      RequestPreroll(retry_index);
     }
+    return;
   }
 
-  ma_device_config device_config =
-      ma_device_config_init(ma_device_type_playback);
-  device_config.playback.format = decoder_.outputFormat;
-  device_config.playback.channels = decoder_.outputChannels;
-  device_config.sampleRate = decoder_.outputSampleRate;
-  device_config.dataCallback = AudioPlayer::DataCallback;
-  device_config.pUserData = this;
+  if (job->succeeded) {
+    job->succeeded = MatchEngineFormat(job.get());
+  }
 
-  if (ma_device_init(&context_, &device_config, &device_) != MA_SUCCESS) {
-    ma_decoder_uninit(&decoder_);
-    ma_context_uninit(&context_);
+  if (!job->succeeded) {
+    ExportTrace(*job, " (failed)");
     state_ = PlayerState::READY;
     sendPlaybackEvent();
+    if (job->method_call != nullptr) {
+      std::string message =
+          job->no_output ? "no audio output device could be opened"
+                         : "failed to load " + job->path;
+      fl_method_call_respond_error(job->method_call, "error", message.c_str(),
+                                   nullptr, nullptr);
+    }
+    return;
+  }
 
-    return false;
+  // Detaching first means the callback is no longer reading the ring, then
+  // the decode thread is kept out while the track is swapped.
+  AudioEngine &engine = AudioEngine::Instance();
+  auto commit_start = LoadTrace::Clock::now();
+  if (attached_) {
+    engine.Detach(this);
+    attached_ = false;
   }
 
-  initialized_ = true;
+  int preroll_index = job->index + 1 < (int)items_.size() ? job->index + 1 : -1;
+  {
+    std::lock_guard<std::mutex> lock(decoder_mutex_);
+
+    track_ = std::move(job->track);
+    next_track_.reset();
+    item_count_ = (int)items_.size();
+    decode_index_ = job->index;
+    next_index_ = -1;
+    preroll_index_ = preroll_index;
+
+    ma_uint64 ring_frames =
+        (ma_uint64)options_.decode_buffer_ms * engine.sample_rate() / 1000;
+    output_rate_ = engine.sample_rate();
+    ring_.init(engine.channels(), kRingBlockFrames,
+               (ma_uint32)((ring_frames + kRingBlockFrames - 1) /
+                           kRingBlockFrames));
+    stretch_.Configure(engine.channels(), engine.sample_rate());
+    stretch_input_.resize((size_t)kRingBlockFrames * engine.channels());
+    ResetRing(job->start_frame);
+    current_index_ = job->index;
+    initialized_ = true;
+  }
+  decode_cv_.notify_one();
 
-  ma_uint64 total_frames = 0;
-  ma_decoder_get_length_in_pcm_frames(&decoder_, &total_frames);
-  duration_ = (total_frames * 1000000) / decoder_.outputSampleRate;
+  if (preroll_index >= 0) {
+    RequestPreroll(preroll_index);
+  }
 
   if (playing_) {
-    ma_device_start(&device_);
+    attached_ = engine.Attach(this);
+  }
+
+  auto ready = LoadTrace::Clock::now();
+  job->trace.Add("commit", commit_start, ready);
+  ExportTrace(*job, "");
+  g_autoptr(FlValue) timing = timing_report(job->trace, ready);
+  if (load_timing_ != nullptr) {
+    fl_value_unref(load_timing_);
   }
+  load_timing_ = fl_value_ref(timing);
 
   state_ = PlayerState::READY;
   sendPlaybackEvent();
 
+  if (job->method_call != nullptr) {
+    g_autoptr(FlValue) result = fl_value_new_map();
+    fl_value_set_string_take(result, "duration", fl_value_new_int(duration()));
+    fl_value_set_string_take(result, "conversions",
+                             conversion_report(*track_, engine));
+    fl_value_set_string_take(result, "latency", latency_report(engine));
+    fl_value_set_string(result, "timing", timing);
+    fl_method_call_respond_success(job->method_call, result, nullptr);
+  }
+}
+
+// Writes the job's stages to the trace file, if one was asked for.
+void AudioPlayer::ExportTrace(const LoadJob &job, const char *outcome) {
+  const char *kind = job.refine ? "refine" : job.preroll ? "preroll" : "load";
+  job.trace.Export(id_ + " " + kind + " #" + std::to_string(job.index) + " " +
+                       job.path + outcome,
+                   LoadTrace::Clock::now());
+}
+
+// Brings the engine and a natively opened track to the same format,
+// reopening the device at the track's. Returns false if the track had to
+// be reopened converted and that failed.
+bool AudioPlayer::MatchEngineFormat(LoadJob *job) {
+  AudioEngine &engine = AudioEngine::Instance();
+  Track *track = job->track.get();
+  if (track->channels() == engine.channels() &&
+      track->output_rate() == engine.sample_rate()) {
+    return true;
+  }
+
+  // The device can only be reopened with nothing rendering into it.
+  if (attached_) {
+    engine.Detach(this);
+    attached_ = false;
+  }
+  {
+    LoadTrace::Scope stage(&job->trace, "deviceReopen");
+    if (engine.Reconfigure(track->sample_rate(), track->channels())) {
+      return true;
+    }
+  }
+
+  // The backend will not take that format, or other players are using the
+  // device as it is; convert after all. Rare enough to open the file again
+  // right here.
+  job->track = Track::Open(job->path, engine.channels(), engine.sample_rate(),
+                           &job->trace);
+  if (job->track == nullptr) {
+    return false;
+  }
+  if (job->start_frame > 0) {
+    job->track->Seek(job->start_frame);
+  }
   return true;
 }
 
+void AudioPlayer::CommitRefine(std::unique_ptr<LoadJob> job) {
+  // The playlist may have been replaced while the file was being scanned.
+  {
+    std::lock_guard<std::mutex> lock(load_mutex_);
+    if (job->index >= (int)playlist_.size() ||
+        playlist_[job->index] != job->path) {
+      return;
+    }
+  }
+
+  ItemInfo &item = items_[job->index];
+  item.refining = false;
+  if (!job->succeeded) {
+    return;
+  }
+
+  if (job->seek_index != nullptr) {
+    item.seek_index = job->seek_index;
+
+    // The decode thread only touches its tracks under decoder_mutex_.
+    std::lock_guard<std::mutex> lock(decoder_mutex_);
+    if (track_ != nullptr && decode_index_ == job->index) {
+      track_->BindSeekIndex(job->seek_index);
+    }
+    if (next_track_ != nullptr && next_index_ == job->index) {
+      next_track_->BindSeekIndex(job->seek_index);
+    }
+  }
+
+  item.duration_exact = true;
+  if (item.duration == job->duration) {
+    return;
+  }
+  item.duration = job->duration;
+
+  if (job->index == current_index_) {
+    sendPlaybackEvent();
+  }
+}
+
+// Caller holds decoder_mutex_ and the renderer is detached. Drops everything
+// buffered between the decoder and the callback.
+void AudioPlayer::ResetRing(ma_uint64 frame) {
+  decode_cursor_ = frame;
+  stretching_ = false;
+  buffered_frame_ = frame;
+  buffered_index_ = decode_index_;
+  ring_.reset();
+  read_offset_ = 0;
+  end_of_stream_ = false;
+  current_frame_ = frame;
+
+  // Any seek still pending was aimed at the track being replaced.
+  ma_uint64 generation = seek_generation_;
+  decode_generation_ = generation;
+  applied_generation_ = generation;
+  rendered_generation_ = generation;
+  render_generation_ = generation;
+  fade_in_frames_ = 0;
+}
+
 void AudioPlayer::play() {
   playing_ = true;
   state_ = PlayerState::READY;
-  if (!initialized_) {
+  if (!initialized_ || attached_) {
+    return;
+  }
+
+  // Another player reopened the device in a different format while this
+  // one was stopped; what is buffered no longer fits it.
+  AudioEngine &engine = AudioEngine::Instance();
+  if (ring_.channels() != engine.channels() ||
+      output_rate_ != engine.sample_rate()) {
+    StartLoad(current_index_, position(), nullptr);
     return;
   }
-  ma_device_start(&device_);
+  attached_ = engine.Attach(this);
 }
 
 void AudioPlayer::pause() {
   playing_ = false;
   state_ = PlayerState::READY;
-  if (!initialized_) {
+  if (!attached_) {
     return;
   }
-  ma_device_stop(&device_);
+  AudioEngine::Instance().Detach(this);
+  attached_ = false;
 }
 
 void AudioPlayer::stop() {
   playing_ = false;
   state_ = PlayerState::IDLE;
-  if (!initialized_) {
+  if (!attached_) {
     return;
   }
-  ma_device_stop(&device_);
+  AudioEngine::Instance().Detach(this);
+  attached_ = false;
 }
 
-void AudioPlayer::seek(int64_t positionMs) {
+void AudioPlayer::seek(int64_t positionMs, int index) {
   if (!initialized_) {
     return;
   }
-  ma_uint64 frames = positionMs * (int64_t)decoder_.outputSampleRate / 1000000;
-  seek_frame_ = frames;
-  need_seek_ = true;
+  if (index < 0) {
+    index = current_index_;
+  }
+  if (index >= (int)items_.size()) {
+    return;
+  }
+
+  // Only posted here; the decode thread does the repositioning, so neither
+  // this thread nor the device callback waits on file IO.
+  bool in_place;
+  {
+    std::lock_guard<std::mutex> lock(decoder_mutex_);
+
+    // Once the decode thread has moved on to the next item (or the target is
+    // another item altogether) the track has to be reopened.
+    in_place = index == decode_index_;
+    if (in_place) {
+      seek_frame_ = positionMs * (int64_t)track_->sample_rate() / 1000000;
+      seek_generation_.fetch_add(1, std::memory_order_release);
+    }
+  }
+
+  if (!in_place) {
+    StartLoad(index, positionMs, nullptr);
+    return;
+  }
+  decode_cv_.notify_one();
+
+  seek_position_ = positionMs;
+  current_index_ = index;
+  if (state_ == PlayerState::COMPLETED) {
+    state_ = PlayerState::READY;
+    sendPlaybackEvent();
+  }
+}
+
+// Moves the volume to `volume` over rampMs, sample by sample in the audio
+// callback, so a whole fade costs one call. Ramps only advance while
+// playing; zero applies the volume from the next callback.
+void AudioPlayer::setVolume(double volume, int64_t rampMs) {
+  ma_uint32 sample_rate = AudioEngine::Instance().sample_rate();
+  volume_ramp_request_ = (ma_uint32)std::min<int64_t>(
+      rampMs * sample_rate / 1000, std::numeric_limits<ma_uint32>::max());
+  volume_ = volume;
+  volume_generation_.fetch_add(1, std::memory_order_release);
+}
+
+// Plays faster or slower, at the same pitch or not depending on the speed
+// mode. Either way the change happens on the decode thread, ahead of the
+// callback, so what is already buffered is decoded again from the current
+// position for it to be heard straight away.
+void AudioPlayer::setSpeed(double speed) {
+  speed = std::min(std::max(speed, kMinSpeed), kMaxSpeed);
+  if (speed == speed_) {
+    return;
+  }
+  speed_ = speed;
+  if (initialized_ && state_ != PlayerState::COMPLETED) {
+    seek(position());
+  }
+  sendPlaybackData();
 }
+
 /* ---------------- queries ---------------- */
 
 int64_t AudioPlayer::position() {
-  if (!initialized_) {
+  // Until the callback plays from the new position, report the target
+  // rather than wherever the old audio had got to.
+  if (rendered_generation_.load() != seek_generation_.load()) {
+    return seek_position_;
+  }
+
+  int index = current_index_;
+  if (!initialized_ || index >= (int)items_.size() ||
+      items_[index].sample_rate == 0) {
     return 0;
   }
-  return (current_frame_ * 1000000) / decoder_.outputSampleRate;
+  return (current_frame_ * 1000000) / items_[index].sample_rate;
 }
 
-/* ---------------- miniaudio callback ---------------- */
+int64_t AudioPlayer::buffered_position(int index) {
+  if (!initialized_ || index >= (int)items_.size()) {
+    return 0;
+  }
+  const ItemInfo &item = items_[index];
 
-void AudioPlayer::DataCallback(ma_device *device, void *output, const void *,
-                               ma_uint32 frameCount) {
-  auto *self = static_cast<AudioPlayer *>(device->pUserData);
-  if (self->state_ == PlayerState::COMPLETED) {
-    return;
+  // Nothing is decoded from a seek target until the decoder gets there.
+  if (applied_generation_.load() != seek_generation_.load()) {
+    return position();
+  }
+  // Decoding has finished the item, or moved on past it.
+  int buffered_index = buffered_index_.load();
+  if (buffered_index > index || end_of_stream_.load()) {
+    return item.duration;
+  }
+  if (buffered_index < index || item.sample_rate == 0) {
+    return position();
   }
 
-  ma_uint64 frames_read = 0;
-  ma_decoder_read_pcm_frames(&self->decoder_, output, frameCount, &frames_read);
+  int64_t buffered =
+      (int64_t)(buffered_frame_.load() * 1000000 / item.sample_rate);
+  return std::max(std::min(buffered, item.duration), position());
+}
 
-  float *samples = static_cast<float *>(output);
-  double gain = self->volume_;
-  ma_uint32 channels = device->playback.channels;
+FlValue *AudioPlayer::stats() {
+  CallbackStats::Snapshot callback =
+      AudioEngine::Instance().callback_stats();
+
+  FlValue *histogram = fl_value_new_list();
+  FlValue *limits = fl_value_new_list();
+  for (size_t i = 0; i < CallbackStats::kBuckets; ++i) {
+    fl_value_append_take(histogram,
+                         fl_value_new_int((int64_t)callback.buckets[i]));
+    // The last bucket is open-ended.
+    if (i + 1 < CallbackStats::kBuckets) {
+      fl_value_append_take(
+          limits, fl_value_new_int((int64_t)CallbackStats::bucket_limit_us(i)));
+    }
+  }
 
-  for (ma_uint64 i = 0; i < frames_read * channels; ++i) {
-    samples[i] *= static_cast<float>(gain);
+  FlValue *map = fl_value_new_map();
+  fl_value_set_string_take(map, "callbacks",
+                           fl_value_new_int((int64_t)callback.callbacks));
+  fl_value_set_string_take(map, "callbackHistogram", histogram);
+  fl_value_set_string_take(map, "callbackHistogramLimitsUs", limits);
+  fl_value_set_string_take(map, "callbackMeanUs",
+                           fl_value_new_float(
+                               callback.callbacks > 0
+                                   ? callback.busy_ns / 1000.0 /
+                                         callback.callbacks
+                                   : 0.0));
+  fl_value_set_string_take(map, "callbackMaxUs",
+                           fl_value_new_float(callback.max_ns / 1000.0));
+  fl_value_set_string_take(map, "overruns",
+                           fl_value_new_int((int64_t)callback.overruns));
+  fl_value_set_string_take(map, "dspLoad", fl_value_new_float(callback.load()));
+  fl_value_set_string_take(map, "dspLoadPeak",
+                           fl_value_new_float(callback.peak_load));
+  fl_value_set_string_take(map, "underruns",
+                           fl_value_new_int((int64_t)underruns_.load()));
+  fl_value_set_string_take(map, "underrunFrames",
+                           fl_value_new_int((int64_t)underrun_frames_.load()));
+  fl_value_set_string_take(map, "seekStalls",
+                           fl_value_new_int((int64_t)seek_stalls_.load()));
+  fl_value_set_string_take(map, "decodeErrors",
+                           fl_value_new_int((int64_t)decode_errors_.load()));
+  return map;
+}
+
+int64_t AudioPlayer::duration() {
+  int index = current_index_;
+  if (index >= (int)items_.size()) {
+    return 0;
   }
+  return items_[index].duration;
+}
 
-  self->current_frame_ += frames_read;
+/* ---------------- engine callback ---------------- */
 
-  if (self->need_seek_) {
-    self->need_seek_ = false;
-    ma_decoder_seek_to_pcm_frame(&self->decoder_, self->seek_frame_);
-    self->current_frame_ = self->seek_frame_;
+void AudioPlayer::Render(float *output, ma_uint32 frameCount) {
+  if (state_ == PlayerState::COMPLETED) {
     return;
   }
 
+  const DspKernels &dsp = Dsp();
+  ma_uint32 channels = ring_.channels();
+
+  // A new volume: ramp from wherever the gain is now.
+  ma_uint64 volume_generation =
+      volume_generation_.load(std::memory_order_acquire);
+  if (volume_generation != render_volume_generation_) {
+    render_volume_generation_ = volume_generation;
+    volume_target_ = static_cast<float>(volume_.load());
+    volume_ramp_frames_ = volume_ramp_request_.load();
+    volume_step_ = volume_ramp_frames_ > 0
+                       ? (volume_target_ - gain_) / volume_ramp_frames_
+                       : 0.0f;
+    if (volume_ramp_frames_ == 0) {
+      gain_ = volume_target_;
+    }
+  }
+
+  // Read the generations and end-of-stream before the ring so a final block
+  // committed just ahead of the flag is never mistaken for an empty ring.
+  // End-of-stream only counts once the latest seek has been applied.
+  ma_uint64 target = seek_generation_.load(std::memory_order_acquire);
+  bool end_of_stream =
+      applied_generation_.load(std::memory_order_acquire) == target &&
+      end_of_stream_.load(std::memory_order_acquire);
+
+  ma_uint32 frames_read = 0;
+
+  // A seek was requested: ramp what was about to play down to silence
+  // rather than cutting it off. The rest of it is dropped below.
+  if (target != render_generation_) {
+    PcmBlock *block = ring_.read_block();
+    if (block != nullptr && block->generation == render_generation_) {
+      ma_uint32 count = std::min(
+          {block->frames - read_offset_, frameCount, kSeekFadeFrames});
+      const float *src = block->samples + read_offset_ * channels;
+      ApplyVolume(dsp, output, src, count, channels);
+      dsp.gain_ramp(output, output, count, channels, 1.0f,
+                    -1.0f / (float)count);
+      frames_read = count;
+    }
+    render_generation_ = target;
+    fade_in_frames_ = kSeekFadeFrames;
+  }
+
+  while (frames_read < frameCount) {
+    PcmBlock *block = ring_.read_block();
+    if (block == nullptr) {
+      break;
+    }
+
+    // Decoded before the latest seek.
+    if (block->generation < render_generation_) {
+      ring_.commit_read();
+      read_offset_ = 0;
+      continue;
+    }
+    // Decoded after a seek newer than the one this callback started with;
+    // the next callback fades over to it.
+    if (block->generation > render_generation_) {
+      break;
+    }
+
+    ma_uint32 count =
+        std::min(block->frames - read_offset_, frameCount - frames_read);
+    const float *src = block->samples + read_offset_ * channels;
+    float *dst = output + frames_read * channels;
+    ApplyVolume(dsp, dst, src, count, channels);
+    if (fade_in_frames_ > 0) {
+      ma_uint32 fade = std::min(count, fade_in_frames_);
+      dsp.gain_ramp(dst, dst, fade, channels,
+                    1.0f - (float)fade_in_frames_ / kSeekFadeFrames,
+                    1.0f / kSeekFadeFrames);
+      fade_in_frames_ -= fade;
+    }
+
+    frames_read += count;
+    read_offset_ += count;
+    current_frame_ =
+        block->source_frame +
+        (ma_uint64)read_offset_ * block->source_frames / block->frames;
+    rendered_generation_.store(render_generation_, std::memory_order_release);
+
+    if ((int)block->index != current_index_) {
+      current_index_ = block->index;
+      rt_events_.push(
+          RtEvent{RtEventKind::kIndexChanged, block->index, current_frame_});
+    }
+
+    if (read_offset_ == block->frames) {
+      ring_.commit_read();
+      read_offset_ = 0;
+    }
+  }
+
   if (frames_read < frameCount) {
-    std::memset(samples + frames_read * channels, 0,
-                (frameCount - frames_read) * channels * sizeof(float));
-    self->state_ = PlayerState::COMPLETED;
-    self->sendPlaybackEvent();
+    dsp.clear(output + frames_read * channels,
+              (size_t)(frameCount - frames_read) * channels);
+
+    // Anything short of end-of-stream is an underrun or a seek still being
+    // applied; keep playing silence until the decode thread catches up.
+    if (end_of_stream && ring_.readable() == 0) {
+      state_ = PlayerState::COMPLETED;
+      rt_events_.push(RtEvent{RtEventKind::kCompleted,
+                              (ma_uint32)current_index_.load(),
+                              current_frame_});
+    } else if (rendered_generation_.load(std::memory_order_relaxed) !=
+               render_generation_) {
+      seek_stalls_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      underruns_.fetch_add(1, std::memory_order_relaxed);
+      underrun_frames_.fetch_add(frameCount - frames_read,
+                                 std::memory_order_relaxed);
+    }
+  }
+}
+
+// Copies frames at the player volume, moving along any ramp in progress.
+// Audio callback only.
+void AudioPlayer::ApplyVolume(const DspKernels &dsp, float *dst,
+                              const float *src, ma_uint32 frames,
+                              ma_uint32 channels) {
+  if (volume_ramp_frames_ > 0) {
+    ma_uint32 count = std::min(frames, volume_ramp_frames_);
+    dsp.gain_ramp(dst, src, count, channels, gain_, volume_step_);
+    volume_ramp_frames_ -= count;
+    // Land exactly on the target rather than wherever rounding got to.
+    gain_ = volume_ramp_frames_ > 0 ? gain_ + volume_step_ * count
+                                    : volume_target_;
+    dst += (size_t)count * channels;
+    src += (size_t)count * channels;
+    frames -= count;
+  }
+  if (frames > 0) {
+    dsp.gain(dst, src, (size_t)frames * channels, gain_);
+  }
+}
+
+/* ---------------- decode thread ---------------- */
+
+void AudioPlayer::DecodeLoop() {
+  std::unique_lock<std::mutex> lock(decoder_mutex_);
+
+  // When the ring is full there is nothing to wake us (the callback must not
+  // signal), so poll at a fraction of the buffer depth. Right after a seek
+  // the ring is full of audio the callback is about to drop, so start
+  // polling fast and back off.
+  auto poll_interval = std::chrono::milliseconds(
+      std::max<ma_uint32>(options_.decode_buffer_ms / 4, 1));
+  auto full_wait = poll_interval;
+
+  while (!decode_quit_) {
+    ma_uint64 target = seek_generation_.load(std::memory_order_acquire);
+    if (track_ && target != decode_generation_) {
+      track_->Seek(seek_frame_);
+      CountDecodeErrors();
+      decode_cursor_ = seek_frame_;
+      stretching_ = false;
+      buffered_frame_ = seek_frame_;
+      decode_generation_ = target;
+      end_of_stream_.store(false, std::memory_order_relaxed);
+      applied_generation_.store(target, std::memory_order_release);
+      full_wait = std::chrono::milliseconds(1);
+    }
+
+    if (!track_ || end_of_stream_) {
+      decode_cv_.wait(lock);
+      continue;
+    }
+
+    PcmBlock *block = ring_.write_block();
+    if (block == nullptr) {
+      decode_cv_.wait_for(lock, full_wait);
+      full_wait = std::min(full_wait * 2, poll_interval);
+      continue;
+    }
+
+    double speed = speed_.load(std::memory_order_relaxed);
+    if (options_.speed_mode == SpeedMode::kVarispeed) {
+      track_->SetVarispeed(speed);
+    } else if (!stretching_ && speed != 1.0) {
+      stretch_.Reset(speed);
+      stretch_origin_ = decode_cursor_;
+      stretching_ = true;
+    }
+
+    ma_uint64 source_frame = decode_cursor_;
+    ma_uint64 source_frames = 0;
+    bool at_end = false;
+    ma_uint32 frames_read;
+    if (stretching_) {
+      stretch_.set_speed(speed);
+      frames_read = ReadStretched(block->samples, ring_.block_frames(),
+                                  &source_frame, &source_frames, &at_end);
+    } else {
+      frames_read = track_->Read(block->samples, ring_.block_frames(),
+                                 &source_frames, &at_end);
+    }
+
+    CountDecodeErrors();
+
+    if (frames_read > 0) {
+      block->frames = frames_read;
+      block->index = (ma_uint32)decode_index_;
+      block->source_frame = source_frame;
+      block->source_frames = (ma_uint32)source_frames;
+      block->generation = decode_generation_;
+      ring_.commit_write();
+    }
+    decode_cursor_ = source_frame + source_frames;
+    buffered_frame_.store(decode_cursor_, std::memory_order_relaxed);
+    NotifyBuffered(false);
+
+    if (!at_end) {
+      continue;
+    }
+
+    // Hand over to the prerolled item. Its first frames go into the very
+    // next block, so the callback plays the two back to back.
+    if (next_track_) {
+      track_ = std::move(next_track_);
+      decode_index_ = next_index_;
+      decode_cursor_ = 0;
+      stretching_ = false;
+      buffered_frame_ = 0;
+      buffered_index_ = decode_index_;
+      next_index_ = -1;
+      preroll_index_ = decode_index_ + 1 < item_count_ ? decode_index_ + 1 : -1;
+      if (preroll_index_ >= 0) {
+        RequestPreroll(preroll_index_);
+      }
+      continue;
+    }
+
+    // The next item is still being opened.
+    if (preroll_index_ >= 0) {
+      decode_cv_.wait(lock);
+      continue;
+    }
+
+    end_of_stream_.store(true, std::memory_order_release);
+    NotifyBuffered(true);
+  }
+}
+
+// Moves what track_ has counted into decode_errors_. Decode thread.
+void AudioPlayer::CountDecodeErrors() {
+  ma_uint32 errors = track_->take_decode_errors();
+  if (errors > 0) {
+    decode_errors_.fetch_add(errors, std::memory_order_relaxed);
+  }
+}
+
+// Has the main loop send a playback event carrying the buffered position,
+// unless one went out less than kBufferedUpdateInterval ago. Decode thread.
+void AudioPlayer::NotifyBuffered(bool force) {
+  auto now = std::chrono::steady_clock::now();
+  if (!force && now - buffered_notified_ < kBufferedUpdateInterval) {
+    return;
+  }
+  buffered_notified_ = now;
+
+  auto *notice = new BufferedNotice{decode_alive_, this};
+  g_main_context_invoke_full(nullptr, G_PRIORITY_DEFAULT, buffered_notice_cb,
+                             notice, free_buffered_notice);
+}
+
+// Fills output from the time-stretcher, feeding it from track_ as it runs
+// dry. source_frame and source_frames receive the span of the source the
+// output stands for, so positions stay in source time. Decode thread, with
+// decoder_mutex_ held.
+ma_uint32 AudioPlayer::ReadStretched(float *output, ma_uint32 frames,
+                                     ma_uint64 *source_frame,
+                                     ma_uint64 *source_frames, bool *at_end) {
+  ma_uint32 channels = ring_.channels();
+  // The stretcher counts in output-rate frames.
+  double ratio = (double)track_->sample_rate() / track_->output_rate();
+
+  ma_uint32 done = 0;
+  double first = 0;
+  double last = 0;
+  while (done < frames) {
+    double start;
+    double end;
+    ma_uint32 count = stretch_.Pull(output + (size_t)done * channels,
+                                    frames - done, &start, &end);
+    if (count > 0) {
+      first = done == 0 ? start : first;
+      last = end;
+      done += count;
+      continue;
+    }
+    if (stretch_.drained()) {
+      *at_end = true;
+      break;
+    }
+
+    ma_uint32 wanted =
+        std::min(stretch_.input_space(), (ma_uint32)kRingBlockFrames);
+    ma_uint64 read_source_frames = 0;
+    bool track_end = false;
+    ma_uint32 read = track_->Read(stretch_input_.data(), wanted,
+                                  &read_source_frames, &track_end);
+    stretch_.Push(stretch_input_.data(), read);
+    if (track_end) {
+      stretch_.Finish();
+    }
+  }
+
+  *source_frame = stretch_origin_ + (ma_uint64)(first * ratio);
+  *source_frames = (ma_uint64)(last * ratio) - (ma_uint64)(first * ratio);
+  return done;
+}
+
+// Turns what the audio callback queued into playback events. Main thread.
+void AudioPlayer::DrainRtEvents() {
+  rt_events_.acknowledge();
+
+  RtEvent event;
+  while (rt_events_.pop(&event)) {
+    int index = (int)event.index;
+    if (index >= (int)items_.size()) {
+      continue;
+    }
+    const ItemInfo &item = items_[index];
+    int64_t position =
+        item.sample_rate > 0
+            ? (int64_t)(event.frame * 1000000 / item.sample_rate)
+            : 0;
+    PlayerState state = event.kind == RtEventKind::kCompleted
+                            ? PlayerState::COMPLETED
+                            : state_.load();
+    SendPlaybackEvent(state, position, item.duration, index);
+  }
+
+  // Whatever was dropped, the current state supersedes it.
+  if (rt_events_.take_overflow()) {
+    sendPlaybackEvent();
+  }
+}
+
+// Indices into the fields of event_encoder_ and data_encoder_.
+enum PlaybackEventField {
+  kEventProcessingState,
+  kEventUpdatePosition,
+  kEventBufferedPosition,
+  kEventDuration,
+  kEventUpdateTime,
+  kEventCurrentIndex,
+};
+
+enum PlaybackDataField {
+  kDataPlaying,
+  kDataVolume,
+  kDataSpeed,
+  kDataLoopMode,
+  kDataShuffleMode,
+};
+
+void AudioPlayer::SendPlaybackEvent(PlayerState state, int64_t position,
+                                    int64_t duration, int index) {
+  event_encoder_.set_int(kEventProcessingState, (int)state);
+  event_encoder_.set_int(kEventUpdatePosition, position);
+  event_encoder_.set_int(kEventBufferedPosition,
+                         state == PlayerState::COMPLETED
+                             ? duration
+                             : buffered_position(index));
+  event_encoder_.set_int(kEventDuration, duration);
+  event_encoder_.set_int(kEventUpdateTime, g_get_real_time() / 1000);
+  event_encoder_.set_int(kEventCurrentIndex, index);
+
+  g_autoptr(FlValue) message = event_encoder_.Encode();
+  // The READY that ends a load says how long its stages took. The encoded
+  // map may be the encoder's own, so the timing goes on a copy; packed
+  // binary messages have no room for it.
+  if (load_timing_ != nullptr && state == PlayerState::READY &&
+      message != nullptr && fl_value_get_type(message) == FL_VALUE_TYPE_MAP) {
+    FlValue *with_timing = fl_value_new_map();
+    for (size_t i = 0; i < fl_value_get_length(message); ++i) {
+      fl_value_set(with_timing, fl_value_get_map_key(message, i),
+                   fl_value_get_map_value(message, i));
+    }
+    fl_value_set_string(with_timing, "loadTiming", load_timing_);
+    fl_value_unref(message);
+    message = with_timing;
+  }
+  if (state == PlayerState::READY && load_timing_ != nullptr) {
+    fl_value_unref(load_timing_);
+    load_timing_ = nullptr;
+  }
+
+  if (message != nullptr) {
+    fl_event_channel_send(event_channel_, message, nullptr, nullptr);
+  }
+}
+
+void AudioPlayer::SendPlaybackData() {
+  data_encoder_.set_bool(kDataPlaying, playing_);
+  data_encoder_.set_float(kDataVolume, volume_);
+  data_encoder_.set_float(kDataSpeed, speed_);
+  data_encoder_.set_int(kDataLoopMode, 0);
+  data_encoder_.set_int(kDataShuffleMode, 0);
+
+  g_autoptr(FlValue) message = data_encoder_.Encode();
+  if (message != nullptr) {
+    fl_event_channel_send(data_channel_, message, nullptr, nullptr);
   }
 }
 
@@ -316,16 +1449,31 @@ void AudioPlayer::HandleMethodCall(FlMethodCall *method_call) {
   FlValue *args = fl_method_call_get_args(method_call);
 
   if (strcmp(method, "load") == 0) {
-    FlValue *audio_source = lookup_map(args, "audioSource");
-    FlValue *children = lookup_map(audio_source, "children");
-    for (size_t i = 0; i < fl_value_get_length(children); ++i) {
-      FlValue *child = fl_value_get_list_value(children, i);
-
-      FlValue *uri_val = lookup_map(child, "uri");
+    std::vector<std::string> uris;
+    collect_uris(lookup_map(args, "audioSource"), &uris);
+    if (uris.empty()) {
+      fl_method_call_respond_error(method_call, "invalid_args",
+                                   "audioSource has no uri", nullptr, nullptr);
+      return;
+    }
 
-      const char *uri = fl_value_get_string(uri_val);
-      load(uri);
+    FlValue *index_val = lookup_map(args, "initialIndex");
+    FlValue *position_val = lookup_map(args, "initialPosition");
+    int index = 0;
+    int64_t position = 0;
+    if (index_val != nullptr &&
+        fl_value_get_type(index_val) == FL_VALUE_TYPE_INT) {
+      index = std::clamp((int)fl_value_get_int(index_val), 0,
+                         (int)uris.size() - 1);
+    }
+    if (position_val != nullptr &&
+        fl_value_get_type(position_val) == FL_VALUE_TYPE_INT) {
+      position = fl_value_get_int(position_val);
     }
+
+    // Answered when the background load finishes.
+    load(uris, index, position, method_call);
+    return;
   } else if (strcmp(method, "play") == 0) {
     play();
   } else if (strcmp(method, "pause") == 0) {
@@ -333,10 +1481,41 @@ void AudioPlayer::HandleMethodCall(FlMethodCall *method_call) {
   } else if (strcmp(method, "stop") == 0) {
     stop();
   } else if (strcmp(method, "seek") == 0) {
-    seek(fl_value_get_int(lookup_map(args, "position")));
+    FlValue *position_val = lookup_map(args, "position");
+    FlValue *index_val = lookup_map(args, "index");
+    int64_t position = 0;
+    int index = -1;
+    if (position_val != nullptr &&
+        fl_value_get_type(position_val) == FL_VALUE_TYPE_INT) {
+      position = fl_value_get_int(position_val);
+    }
+    if (index_val != nullptr &&
+        fl_value_get_type(index_val) == FL_VALUE_TYPE_INT) {
+      index = (int)fl_value_get_int(index_val);
+    }
+    seek(position, index);
   } else if (strcmp(method, "setVolume") == 0) {
-    FlValue *volume = lookup_map(args, "volume");
-    volume_ = fl_value_get_float(volume);
+    FlValue *volume_val = lookup_map(args, "volume");
+    FlValue *ramp_val = lookup_map(args, "rampMs");
+    if (volume_val != nullptr &&
+        fl_value_get_type(volume_val) == FL_VALUE_TYPE_FLOAT) {
+      int64_t ramp_ms = 0;
+      if (ramp_val != nullptr &&
+          fl_value_get_type(ramp_val) == FL_VALUE_TYPE_INT) {
+        ramp_ms = std::max<int64_t>(fl_value_get_int(ramp_val), 0);
+      }
+      setVolume(fl_value_get_float(volume_val), ramp_ms);
+    }
+  } else if (strcmp(method, "setSpeed") == 0) {
+    FlValue *speed_val = lookup_map(args, "speed");
+    if (speed_val != nullptr &&
+        fl_value_get_type(speed_val) == FL_VALUE_TYPE_FLOAT) {
+      setSpeed(fl_value_get_float(speed_val));
+    }
+  } else if (strcmp(method, "getStats") == 0) {
+    g_autoptr(FlValue) result = stats();
+    fl_method_call_respond_success(method_call, result, nullptr);
+    return;
   } else {
     // I don't care
   }
@@ -3,10 +3,25 @@
 #include <flutter_linux/flutter_linux.h>
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include "audio_engine.h"
+#include "dsp_kernels.h"
+#include "event_encoder.h"
+#include "load_trace.h"
 #include "miniaudio.h"
+#include "pcm_ring_buffer.h"
+#include "rt_event_queue.h"
+#include "time_stretch.h"
+#include "track.h"
 
 namespace just_audio_windows_linux {
 
@@ -14,49 +29,245 @@ namespace just_audio_windows_linux {
 
 enum class PlayerState { IDLE, LOADING, READY = 3, COMPLETED = 4 };
 
+/* ---------------- Player options ---------------- */
+
+// How setSpeed() changes the speed.
+enum class SpeedMode {
+  // Time-stretched, at the original pitch.
+  kPitchPreserving,
+  // Resampled, pitch moving with the speed like tape; much cheaper.
+  kVarispeed,
+};
+
+// Optional settings read from the "init" call.
+struct AudioPlayerOptions {
+  // How far ahead of the audio callback the decode thread runs.
+  ma_uint32 decode_buffer_ms = 500;
+  // Reopen the device at each loaded item's own rate and channel count
+  // rather than converting to a fixed stereo output. Items played back to
+  // back after it are still converted, to keep the handover gapless.
+  bool native_output = false;
+  // Layout of event and data channel messages.
+  EventEncoding event_encoding = EventEncoding::kFull;
+  SpeedMode speed_mode = SpeedMode::kPitchPreserving;
+};
+
 /* ---------------- AudioPlayer ---------------- */
 
-class AudioPlayer {
+struct LoadJob;
+
+class AudioPlayer : public AudioRenderer {
 public:
-  AudioPlayer(const std::string &id, FlBinaryMessenger *messenger);
-  ~AudioPlayer();
+  AudioPlayer(const std::string &id, FlBinaryMessenger *messenger,
+              const AudioPlayerOptions &options = AudioPlayerOptions());
+  ~AudioPlayer() override;
 
   /* -------- control -------- */
-  bool load(const std::string &uri);
+  // Replaces the playlist and opens item `index` on the loader thread.
+  // method_call, if any, is answered once the load completes, fails or is
+  // superseded by a later load.
+  void load(const std::vector<std::string> &uris, int index,
+            int64_t positionMs, FlMethodCall *method_call = nullptr);
   void play();
   void pause();
   void stop();
-  void seek(int64_t positionMs);
+  // index < 0 seeks within the item currently playing.
+  void seek(int64_t positionMs, int index = -1);
+  void setVolume(double volume, int64_t rampMs = 0);
+  void setSpeed(double speed);
 
   /* -------- query -------- */
   int64_t position();
+  int64_t duration();
+  // How far decoding has got into item `index`, as a position.
+  int64_t buffered_position(int index);
+  // Engine callback timing and this player's glitch counters, as the
+  // getStats response.
+  FlValue *stats();
 
   /* -------- flutter method dispatch -------- */
   void HandleMethodCall(FlMethodCall *method_call);
 
+  /* -------- main-thread completion of load() -------- */
+  void CommitLoad(std::unique_ptr<LoadJob> job);
+  void CommitRefine(std::unique_ptr<LoadJob> job);
+
+  /* -------- main-thread delivery of audio thread events -------- */
+  void DrainRtEvents();
+  void SendPlaybackEvent(PlayerState state, int64_t position,
+                         int64_t duration, int index);
+  void SendPlaybackData();
+  bool MatchEngineFormat(LoadJob *job);
+
   /* -------- flutter channels -------- */
   FlMethodChannel *player_channel_ = nullptr;
+  FlEventChannel *event_channel_ = nullptr;
+  FlEventChannel *data_channel_ = nullptr;
 
-  /* -------- miniaudio -------- */
-  ma_context context_;
-  ma_decoder decoder_{};
-  ma_device device_{};
-
+  /* -------- playback state -------- */
+  // Position and playlist index of the frame the callback last played.
   std::atomic<ma_uint64> current_frame_{0};
-  ma_uint64 seek_frame_{0};
-  bool need_seek_ = false;
-  PlayerState state_{PlayerState::IDLE};
+  std::atomic<int> current_index_{0};
+  // Render() sets COMPLETED; everything else is the main thread's.
+  std::atomic<PlayerState> state_{PlayerState::IDLE};
+  // The volume last asked for; the callback may still be ramping to it.
   std::atomic<double> volume_{1.0};
 
-  double speed_ = 1.0;
+  // Playback speed; the decode thread time-stretches or resamples to it.
+  std::atomic<double> speed_{1.0};
   bool initialized_ = false;
   bool playing_ = false;
-  int64_t duration_ = 0;
+
+  /* -------- engine callback -------- */
+  void Render(float *output, ma_uint32 frameCount) override;
 
 private:
-  /* -------- miniaudio callback -------- */
-  static void DataCallback(ma_device *device, void *output, const void *input,
-                           ma_uint32 frameCount);
+  /* -------- worker threads -------- */
+  void DecodeLoop();
+  void LoadLoop();
+  void RunLoadJob(LoadJob *job);
+  void StartLoad(int index, int64_t positionMs, FlMethodCall *method_call,
+                 LoadTrace trace = LoadTrace());
+  void ExportTrace(const LoadJob &job, const char *outcome);
+  void RequestPreroll(int index);
+  void RequestRefine(int index);
+  void ResetRing(ma_uint64 frame);
+  void NotifyBuffered(bool force);
+  void CountDecodeErrors();
+  ma_uint32 ReadStretched(float *output, ma_uint32 frames,
+                          ma_uint64 *source_frame, ma_uint64 *source_frames,
+                          bool *at_end);
+  void ApplyVolume(const DspKernels &dsp, float *dst, const float *src,
+                   ma_uint32 frames, ma_uint32 channels);
+
+  std::string id_;
+  AudioPlayerOptions options_;
+  EventEncoder event_encoder_;
+  EventEncoder data_encoder_;
+
+  // decoder_mutex_ guards the tracks, the decode_* fields and the producer
+  // side of ring_; the audio callback only ever touches the consumer side.
+  PcmRingBuffer ring_;
+  ma_uint32 read_offset_ = 0;
+  std::atomic<bool> end_of_stream_{false};
+
+  // The item being decoded and, once prerolled, the one after it. The decode
+  // thread switches between them between two blocks, so playback is gapless.
+  // preroll_index_ is the item still being opened, or -1.
+  std::unique_ptr<Track> track_;
+  std::unique_ptr<Track> next_track_;
+  int item_count_ = 0;
+  int decode_index_ = 0;
+  int next_index_ = -1;
+  int preroll_index_ = -1;
+  ma_uint64 decode_cursor_ = 0;
+
+  // Time-stretch stage between track_ and the ring, used from the first
+  // block decoded at a speed other than 1 until the next seek or item.
+  // stretch_origin_ is the source frame its input started at.
+  TimeStretch stretch_;
+  std::vector<float> stretch_input_;
+  bool stretching_ = false;
+  ma_uint64 stretch_origin_ = 0;
+
+  // End of the latest block written to the ring, in source frames of item
+  // buffered_index_, published for buffered_position(). The decode thread
+  // tells the main loop about it at most every kBufferedUpdateMs.
+  std::atomic<ma_uint64> buffered_frame_{0};
+  std::atomic<int> buffered_index_{0};
+  std::chrono::steady_clock::time_point buffered_notified_;
+
+  // Per-item details for position and duration reporting (main thread only).
+  // duration may come from container headers until a refine job has
+  // measured it; refining is set while that job is queued.
+  struct ItemInfo {
+    int64_t duration = 0;
+    ma_uint32 sample_rate = 0;
+    bool duration_exact = false;
+    bool refining = false;
+    std::shared_ptr<const Mp3SeekIndex> seek_index;
+  };
+  std::vector<ItemInfo> items_;
+
+  // Whether Render() is currently attached to the engine, and the engine
+  // rate the ring was filled for (main thread only).
+  bool attached_ = false;
+  ma_uint32 output_rate_ = 0;
+
+  // Seeks within the item being decoded never stop the device. seek() posts
+  // seek_frame_ and bumps seek_generation_; the decode thread repositions
+  // the track, tags every later block with that generation and publishes
+  // applied_generation_. Render() drops older blocks, fading out and back
+  // in around the gap, and publishes rendered_generation_ once new audio
+  // plays. seek_frame_ and decode_generation_ are guarded by
+  // decoder_mutex_; render_generation_ and fade_in_frames_ belong to
+  // Render().
+  std::atomic<ma_uint64> seek_generation_{0};
+  std::atomic<ma_uint64> applied_generation_{0};
+  std::atomic<ma_uint64> rendered_generation_{0};
+  ma_uint64 seek_frame_ = 0;
+  ma_uint64 decode_generation_ = 0;
+  ma_uint64 render_generation_ = 0;
+  ma_uint32 fade_in_frames_ = 0;
+  // Reported by position() until rendered_generation_ catches up (main
+  // thread only).
+  int64_t seek_position_ = 0;
+
+  // Per-stage timings of the load just committed, added to the READY event
+  // that follows it (main thread only).
+  FlValue *load_timing_ = nullptr;
+
+  // Glitch counters for stats(). Render() counts callbacks it could not
+  // fill, as seek stalls while nothing from the latest seek has played yet
+  // and as underruns otherwise; the decode thread counts decoder errors.
+  std::atomic<ma_uint64> underruns_{0};
+  std::atomic<ma_uint64> underrun_frames_{0};
+  std::atomic<ma_uint64> seek_stalls_{0};
+  std::atomic<ma_uint64> decode_errors_{0};
+
+  // setVolume() stores volume_ and the ramp length, then bumps
+  // volume_generation_; Render() picks both up and ramps gain_ toward the
+  // target over the following frames. The non-atomic fields belong to
+  // Render().
+  std::atomic<ma_uint64> volume_generation_{0};
+  std::atomic<ma_uint32> volume_ramp_request_{0};
+  ma_uint64 render_volume_generation_ = 0;
+  float gain_ = 1.0f;
+  float volume_target_ = 1.0f;
+  float volume_step_ = 0.0f;
+  ma_uint32 volume_ramp_frames_ = 0;
+
+  std::thread decode_thread_;
+  std::mutex decoder_mutex_;
+  std::condition_variable decode_cv_;
+  bool decode_quit_ = false;
+
+  // load_mutex_ guards pending_load_, preroll_load_, refine_jobs_ and
+  // playlist_; a load is superseded as soon as load_generation_ moves past
+  // the generation it was started with. The loader takes a pending load
+  // first, then a preroll, and refine jobs only when neither is waiting.
+  std::thread load_thread_;
+  std::mutex load_mutex_;
+  std::condition_variable load_cv_;
+  std::unique_ptr<LoadJob> pending_load_;
+  std::unique_ptr<LoadJob> preroll_load_;
+  std::deque<std::unique_ptr<LoadJob>> refine_jobs_;
+  std::vector<std::string> playlist_;
+  std::atomic<ma_uint64> load_generation_{0};
+  bool load_quit_ = false;
+
+  // Render() never calls into GLib; it queues what the main thread should
+  // hear about here, drained by rt_event_source_ on the main loop.
+  RtEventQueue rt_events_;
+  GSource *rt_event_source_ = nullptr;
+
+  // Expires when the player is destroyed, for work queued on the main loop.
+  // The worker threads take their copies from decode_alive_ and
+  // load_alive_, which nothing modifies while they run; alive_ itself is
+  // reset by the destructor before they are joined.
+  std::shared_ptr<bool> alive_ = std::make_shared<bool>(true);
+  std::weak_ptr<bool> decode_alive_ = alive_;
+  std::weak_ptr<bool> load_alive_ = alive_;
 
   /* -------- helpers -------- */
   void sendPlaybackEvent();
@@ -0,0 +1,221 @@
+// Decodes one fixture per codec through Track, opened the way a player load
+// opens it, and reports per codec:
+//   - decode speed as a multiple of real time,
+//   - first-frame latency: open plus the first ring block,
+//   - seek latency: seek plus the first block after it, mean and worst,
+//   - peak resident memory while that codec ran.
+// Needs neither Flutter nor an audio device.
+//
+//   decode_benchmark [fixture_dir] [seconds]
+//
+// bench.wav is written into fixture_dir if it is missing. bench.flac,
+// bench.mp3, bench.ogg (Vorbis) and bench.opus are used when present; the
+// decode_benchmark_fixtures target makes them with ffmpeg.
+
+#define MINIAUDIO_IMPLEMENTATION
+#include "miniaudio.h"
+
+#include "miniaudio_libopus.c"
+#include "miniaudio_libvorbis.c"
+#include "miniaudio_mp3_seek.c"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "pcm_cache.h"
+#include "track.h"
+
+using namespace just_audio_windows_linux;
+
+namespace {
+
+// What a player opens tracks as with the default stereo output; 48 kHz is
+// what most devices run at.
+constexpr ma_uint32 kOutputChannels = 2;
+constexpr ma_uint32 kOutputRate = 48000;
+// The decode thread reads one ring block at a time.
+constexpr ma_uint32 kBlockFrames = 512;
+constexpr int kSeeks = 20;
+
+struct Fixture {
+  const char *codec;
+  const char *file;
+};
+
+const Fixture kFixtures[] = {{"wav", "bench.wav"},
+                             {"flac", "bench.flac"},
+                             {"mp3", "bench.mp3"},
+                             {"vorbis", "bench.ogg"},
+                             {"opus", "bench.opus"}};
+
+using Clock = std::chrono::steady_clock;
+
+double Ms(Clock::duration elapsed) {
+  return std::chrono::duration<double, std::milli>(elapsed).count();
+}
+
+bool Exists(const std::string &path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0;
+}
+
+long FileSize(const std::string &path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 ? (long)st.st_size : 0;
+}
+
+// Two tones with some noise on top, so compressed fixtures made from the
+// same recipe carry a realistic bitrate.
+bool WriteWav(const std::string &path, ma_uint32 seconds) {
+  const ma_uint32 rate = 44100;
+  ma_encoder_config config =
+      ma_encoder_config_init(ma_encoding_format_wav, ma_format_s16, 2, rate);
+  ma_encoder encoder;
+  if (ma_encoder_init_file(path.c_str(), &config, &encoder) != MA_SUCCESS) {
+    return false;
+  }
+
+  std::vector<int16_t> chunk(rate * 2);
+  ma_uint64 frame = 0;
+  ma_uint32 seed = 1;
+  for (ma_uint32 s = 0; s < seconds; ++s) {
+    for (ma_uint32 i = 0; i < rate; ++i, ++frame) {
+      double t = (double)frame / rate;
+      for (int c = 0; c < 2; ++c) {
+        seed = seed * 1664525u + 1013904223u;
+        double noise = ((seed >> 8) / 16777216.0 - 0.5) * 0.2;
+        double tone = 0.4 * std::sin(2 * M_PI * (c == 0 ? 440 : 554) * t);
+        chunk[i * 2 + c] = (int16_t)((tone + noise) * 32767);
+      }
+    }
+    ma_encoder_write_pcm_frames(&encoder, chunk.data(), rate, nullptr);
+  }
+  ma_encoder_uninit(&encoder);
+  return true;
+}
+
+// Resets the kernel's peak RSS counter, so VmHWM covers only what follows.
+// Returns false where that is not supported and the peak is process-wide.
+bool ResetPeakRss() {
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5";
+  return clear_refs.good();
+}
+
+long PeakRssKb() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      return std::strtol(line.c_str() + 6, nullptr, 10);
+    }
+  }
+  return 0;
+}
+
+struct Result {
+  double realtime = 0;
+  double first_frame_ms = 0;
+  double seek_mean_ms = 0;
+  double seek_max_ms = 0;
+  long peak_rss_kb = 0;
+};
+
+bool Run(const std::string &path, Result *result) {
+  std::vector<float> block((size_t)kBlockFrames * kOutputChannels);
+  ma_uint64 source_frames = 0;
+  bool at_end = false;
+
+  auto start = Clock::now();
+  std::unique_ptr<Track> track =
+      Track::Open(path, kOutputChannels, kOutputRate);
+  if (!track) {
+    return false;
+  }
+  ma_uint64 output_frames =
+      track->Read(block.data(), kBlockFrames, &source_frames, &at_end);
+  result->first_frame_ms = Ms(Clock::now() - start);
+
+  ma_uint64 total_source = source_frames;
+  while (!at_end) {
+    output_frames +=
+        track->Read(block.data(), kBlockFrames, &source_frames, &at_end);
+    total_source += source_frames;
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  result->realtime = (double)output_frames / kOutputRate / seconds;
+
+  // The same pseudo-random targets for every codec.
+  ma_uint32 seed = 12345;
+  double total_ms = 0;
+  for (int i = 0; i < kSeeks; ++i) {
+    seed = seed * 1664525u + 1013904223u;
+    ma_uint64 target = total_source * (seed >> 16) / 65536;
+    auto seek_start = Clock::now();
+    track->Seek(target);
+    track->Read(block.data(), kBlockFrames, &source_frames, &at_end);
+    double ms = Ms(Clock::now() - seek_start);
+    total_ms += ms;
+    result->seek_max_ms = std::max(result->seek_max_ms, ms);
+  }
+  result->seek_mean_ms = total_ms / kSeeks;
+  result->peak_rss_kb = PeakRssKb();
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string dir = argc > 1 ? argv[1] : ".";
+  ma_uint32 seconds =
+      argc > 2 ? (ma_uint32)std::strtoul(argv[2], nullptr, 10) : 60;
+  if (seconds == 0) {
+    seconds = 60;
+  }
+
+  // Every fixture is decoded from the file, never replayed from RAM.
+  PcmCache::Instance().Configure(0, 0);
+
+  std::string wav = dir + "/bench.wav";
+  if (!Exists(wav) && !WriteWav(wav, seconds)) {
+    std::fprintf(stderr, "cannot write %s\n", wav.c_str());
+    return 1;
+  }
+
+  bool per_codec_rss = ResetPeakRss();
+  std::printf("output %u ch @ %u Hz, %u-frame reads, %d seeks%s\n\n",
+              kOutputChannels, kOutputRate, kBlockFrames, kSeeks,
+              per_codec_rss ? "" : " (peak RSS is process-wide)");
+  std::printf("%-7s %9s %10s %12s %10s %10s %9s\n", "codec", "size KiB",
+              "realtime x", "first ms", "seek ms", "seek max", "peak MiB");
+
+  int failures = 0;
+  for (const Fixture &fixture : kFixtures) {
+    std::string path = dir + "/" + fixture.file;
+    if (!Exists(path)) {
+      std::printf("%-7s %9s\n", fixture.codec, "missing");
+      continue;
+    }
+
+    ResetPeakRss();
+    Result result;
+    if (!Run(path, &result)) {
+      std::printf("%-7s %9s\n", fixture.codec, "failed");
+      ++failures;
+      continue;
+    }
+    std::printf("%-7s %9ld %10.1f %12.3f %10.3f %10.3f %9.1f\n",
+                fixture.codec, FileSize(path) / 1024, result.realtime,
+                result.first_frame_ms, result.seek_mean_ms, result.seek_max_ms,
+                result.peak_rss_kb / 1024.0);
+  }
+  return failures > 0 ? 1 : 0;
+}
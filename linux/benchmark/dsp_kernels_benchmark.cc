@@ -0,0 +1,206 @@
+// Times each DSP kernel table against the scalar one across device buffer
+// sizes, after checking that the vector paths produce the same output.
+//
+//   dsp_kernels_benchmark [channels]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <vector>
+
+#include "dsp_kernels.h"
+
+using namespace just_audio_windows_linux;
+
+namespace {
+
+// Frames per device period, from tight low-latency setups to large ones.
+const size_t kBufferFrames[] = {64, 128, 256, 480, 512, 1024, 4096};
+
+// Roughly how long each measurement runs.
+constexpr double kTargetSeconds = 0.05;
+
+enum class Kernel {
+  kGain,
+  kGainRamp,
+  kMixAdd,
+  kClear,
+  kDot,
+  kS16ToF32,
+  kF32ToS16
+};
+
+struct KernelInfo {
+  Kernel kernel;
+  const char *name;
+};
+
+const KernelInfo kKernels[] = {{Kernel::kGain, "gain"},
+                               {Kernel::kGainRamp, "gain_ramp"},
+                               {Kernel::kMixAdd, "mix_add"},
+                               {Kernel::kClear, "clear"},
+                               {Kernel::kDot, "dot"},
+                               {Kernel::kS16ToF32, "s16_to_f32"},
+                               {Kernel::kF32ToS16, "f32_to_s16"}};
+
+struct Buffers {
+  std::vector<float> src;
+  std::vector<float> dst;
+  std::vector<int16_t> s16;
+};
+
+void Run(const DspKernels &dsp, Kernel kernel, Buffers &b, size_t count,
+         uint32_t channels) {
+  switch (kernel) {
+  case Kernel::kGain:
+    dsp.gain(b.dst.data(), b.src.data(), count, 0.7f);
+    break;
+  case Kernel::kGainRamp:
+    dsp.gain_ramp(b.dst.data(), b.src.data(), count / channels, channels,
+                  1.0f, -1.0f / (count / channels));
+    break;
+  case Kernel::kMixAdd:
+    dsp.mix_add(b.dst.data(), b.src.data(), count, 0.5f);
+    break;
+  case Kernel::kClear:
+    dsp.clear(b.dst.data(), count);
+    break;
+  case Kernel::kDot:
+    // Stored so the call is not optimised away and can be compared.
+    b.dst[0] = dsp.dot(b.src.data(), b.dst.data() + 1, count - 1);
+    break;
+  case Kernel::kS16ToF32:
+    dsp.s16_to_f32(b.dst.data(), b.s16.data(), count);
+    break;
+  case Kernel::kF32ToS16:
+    dsp.f32_to_s16(b.s16.data(), b.src.data(), count);
+    break;
+  }
+}
+
+// Nanoseconds per call, best of a few runs.
+double Time(const DspKernels &dsp, Kernel kernel, Buffers &b, size_t count,
+            uint32_t channels) {
+  using Clock = std::chrono::steady_clock;
+
+  // Calibrate the iteration count so each run takes about kTargetSeconds.
+  size_t iterations = 1;
+  for (;;) {
+    auto start = Clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+      Run(dsp, kernel, b, count, channels);
+    }
+    double seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+    if (seconds > kTargetSeconds / 10 || iterations > (1u << 30)) {
+      iterations = (size_t)(iterations * kTargetSeconds / seconds) + 1;
+      break;
+    }
+    iterations *= 4;
+  }
+
+  double best = 0;
+  for (int run = 0; run < 3; ++run) {
+    auto start = Clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+      Run(dsp, kernel, b, count, channels);
+    }
+    std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+    double ns = elapsed.count() / iterations;
+    best = run == 0 || ns < best ? ns : best;
+  }
+  return best;
+}
+
+// Compares a table against the scalar one on an odd length, so the vector
+// body and the scalar tail are both exercised.
+bool Verify(const DspKernels &dsp, uint32_t channels) {
+  const DspKernels &ref = *DspFor(DspIsa::kScalar);
+  const size_t count = 1031 * channels;
+  Buffers a, b;
+  a.src.resize(count);
+  a.s16.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    // Past full scale on purpose, to check saturation.
+    a.src[i] = 1.25f * std::sin(i * 0.37f);
+    a.s16[i] = (int16_t)(i * 977);
+  }
+  a.dst.assign(count, 0.25f);
+  b = a;
+
+  for (const KernelInfo &info : kKernels) {
+    Run(ref, info.kernel, a, count, channels);
+    Run(dsp, info.kernel, b, count, channels);
+    // A dot product is summed in a different order per table.
+    float tolerance = info.kernel == Kernel::kDot
+                          ? 1e-4f * std::max(std::fabs(a.dst[0]), 1.0f)
+                          : 1e-6f;
+    for (size_t i = 0; i < count; ++i) {
+      if (std::fabs(a.dst[i] - b.dst[i]) > tolerance ||
+          a.s16[i] != b.s16[i]) {
+        std::fprintf(stderr, "%s: %s differs from scalar at %zu\n", dsp.name,
+                     info.name, i);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  uint32_t channels =
+      argc > 1 ? (uint32_t)std::strtoul(argv[1], nullptr, 10) : 2;
+  if (channels == 0) {
+    channels = 2;
+  }
+
+  std::vector<const DspKernels *> tables;
+  for (DspIsa isa : {DspIsa::kScalar, DspIsa::kSse2, DspIsa::kAvx2}) {
+    if (const DspKernels *dsp = DspFor(isa)) {
+      if (!Verify(*dsp, channels)) {
+        return 1;
+      }
+      tables.push_back(dsp);
+    }
+  }
+  std::printf("selected: %s, %u channels\n\n", Dsp().name, channels);
+
+  std::printf("%-11s %6s", "kernel", "frames");
+  for (const DspKernels *dsp : tables) {
+    std::printf(" %10s ns", dsp->name);
+  }
+  for (size_t t = 1; t < tables.size(); ++t) {
+    std::printf(" %7s x", tables[t]->name);
+  }
+  std::printf("\n");
+
+  for (const KernelInfo &info : kKernels) {
+    for (size_t frames : kBufferFrames) {
+      size_t count = frames * channels;
+      Buffers b;
+      b.src.assign(count, 0.5f);
+      b.dst.assign(count, 0.0f);
+      b.s16.assign(count, 1000);
+
+      std::vector<double> ns;
+      for (const DspKernels *dsp : tables) {
+        ns.push_back(Time(*dsp, info.kernel, b, count, channels));
+      }
+
+      std::printf("%-11s %6zu", info.name, frames);
+      for (double value : ns) {
+        std::printf(" %13.1f", value);
+      }
+      for (size_t t = 1; t < ns.size(); ++t) {
+        std::printf(" %9.2f", ns[0] / ns[t]);
+      }
+      std::printf("\n");
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace just_audio_windows_linux {
+
+/* ---------------- CallbackStats ---------------- */
+
+// How long the device callback takes, against how long the audio it produced
+// lasts. record() runs on the device thread and only does relaxed atomic
+// adds and stores; snapshot() may run anywhere and sees each counter as of
+// some recent callback, not all of them as of the same one.
+class CallbackStats {
+public:
+  // Log-2 buckets of callback duration: bucket 0 holds callbacks under 1 us,
+  // bucket i those from 2^(i-1) up to 2^i us, and the last one anything
+  // longer (over a second).
+  static constexpr size_t kBuckets = 22;
+
+  static constexpr uint64_t bucket_limit_us(size_t bucket) {
+    return uint64_t{1} << bucket;
+  }
+
+  struct Snapshot {
+    uint64_t callbacks = 0;
+    uint64_t buckets[kBuckets] = {};
+    // Total time spent in the callback and the audio it produced.
+    uint64_t busy_ns = 0;
+    uint64_t period_ns = 0;
+    uint64_t max_ns = 0;
+    // Callbacks that took longer than the audio they produced.
+    uint64_t overruns = 0;
+    // Highest busy / period of any single callback, in percent.
+    double peak_load = 0;
+
+    // Mean busy / period, in percent.
+    double load() const {
+      return period_ns > 0 ? 100.0 * busy_ns / period_ns : 0.0;
+    }
+  };
+
+  // Device thread only.
+  void record(uint64_t elapsed_ns, uint64_t period_ns) {
+    uint64_t us = elapsed_ns / 1000;
+    size_t bucket = 0;
+    while (bucket + 1 < kBuckets && us >= bucket_limit_us(bucket)) {
+      ++bucket;
+    }
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    callbacks_.fetch_add(1, std::memory_order_relaxed);
+    busy_ns_.fetch_add(elapsed_ns, std::memory_order_relaxed);
+    period_ns_.fetch_add(period_ns, std::memory_order_relaxed);
+    if (elapsed_ns > period_ns) {
+      overruns_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // The device thread is the only writer, so no compare-exchange.
+    if (elapsed_ns > max_ns_.load(std::memory_order_relaxed)) {
+      max_ns_.store(elapsed_ns, std::memory_order_relaxed);
+    }
+    uint32_t permille =
+        period_ns > 0 ? (uint32_t)(elapsed_ns * 1000 / period_ns) : 0;
+    if (permille > peak_permille_.load(std::memory_order_relaxed)) {
+      peak_permille_.store(permille, std::memory_order_relaxed);
+    }
+  }
+
+  // Only while the device is stopped.
+  void reset() {
+    for (std::atomic<uint64_t> &bucket : buckets_) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    callbacks_.store(0, std::memory_order_relaxed);
+    busy_ns_.store(0, std::memory_order_relaxed);
+    period_ns_.store(0, std::memory_order_relaxed);
+    max_ns_.store(0, std::memory_order_relaxed);
+    overruns_.store(0, std::memory_order_relaxed);
+    peak_permille_.store(0, std::memory_order_relaxed);
+  }
+
+  Snapshot snapshot() const {
+    Snapshot snapshot;
+    for (size_t i = 0; i < kBuckets; ++i) {
+      snapshot.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    }
+    snapshot.callbacks = callbacks_.load(std::memory_order_relaxed);
+    snapshot.busy_ns = busy_ns_.load(std::memory_order_relaxed);
+    snapshot.period_ns = period_ns_.load(std::memory_order_relaxed);
+    snapshot.max_ns = max_ns_.load(std::memory_order_relaxed);
+    snapshot.overruns = overruns_.load(std::memory_order_relaxed);
+    snapshot.peak_load =
+        peak_permille_.load(std::memory_order_relaxed) / 10.0;
+    return snapshot;
+  }
+
+private:
+  std::atomic<uint64_t> buckets_[kBuckets] = {};
+  std::atomic<uint64_t> callbacks_{0};
+  std::atomic<uint64_t> busy_ns_{0};
+  std::atomic<uint64_t> period_ns_{0};
+  std::atomic<uint64_t> max_ns_{0};
+  std::atomic<uint64_t> overruns_{0};
+  std::atomic<uint32_t> peak_permille_{0};
+};
+
+} // namespace just_audio_windows_linux
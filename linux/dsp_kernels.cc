@@ -0,0 +1,342 @@
+#include "dsp_kernels.h"
+
+#include <cmath>
+#include <cstring>
+#include <initializer_list>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JUST_AUDIO_DSP_X86 1
+#endif
+
+namespace just_audio_windows_linux {
+
+static constexpr float kS16Scale = 1.0f / 32768.0f;
+
+/* ---------------- scalar ---------------- */
+
+static void gain_scalar(float *dst, const float *src, size_t count,
+                        float gain) {
+  for (size_t i = 0; i < count; ++i) {
+    dst[i] = src[i] * gain;
+  }
+}
+
+static void gain_ramp_scalar(float *dst, const float *src, size_t frames,
+                             uint32_t channels, float start, float step) {
+  for (size_t f = 0; f < frames; ++f) {
+    float gain = start + step * (float)f;
+    for (uint32_t c = 0; c < channels; ++c) {
+      dst[f * channels + c] = src[f * channels + c] * gain;
+    }
+  }
+}
+
+static void mix_add_scalar(float *dst, const float *src, size_t count,
+                           float gain) {
+  for (size_t i = 0; i < count; ++i) {
+    dst[i] += src[i] * gain;
+  }
+}
+
+// libc's memset is already vectorised and beats hand-written stores, so
+// every table clears through it.
+static void clear_scalar(float *dst, size_t count) {
+  std::memset(dst, 0, count * sizeof(float));
+}
+
+static float dot_scalar(const float *a, const float *b, size_t count) {
+  float sum = 0.0f;
+  for (size_t i = 0; i < count; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+static void s16_to_f32_scalar(float *dst, const int16_t *src, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    dst[i] = src[i] * kS16Scale;
+  }
+}
+
+static void f32_to_s16_scalar(int16_t *dst, const float *src, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    float sample = src[i] * 32768.0f;
+    sample = sample < -32768.0f ? -32768.0f
+             : sample > 32767.0f ? 32767.0f
+                                 : sample;
+    dst[i] = (int16_t)std::lrintf(sample);
+  }
+}
+
+#if defined(JUST_AUDIO_DSP_X86)
+
+/* ---------------- SSE2 ---------------- */
+
+__attribute__((target("sse2"))) static void
+gain_sse2(float *dst, const float *src, size_t count, float gain) {
+  __m128 g = _mm_set1_ps(gain);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128 a = _mm_loadu_ps(src + i);
+    __m128 b = _mm_loadu_ps(src + i + 4);
+    _mm_storeu_ps(dst + i, _mm_mul_ps(a, g));
+    _mm_storeu_ps(dst + i + 4, _mm_mul_ps(b, g));
+  }
+  gain_scalar(dst + i, src + i, count - i, gain);
+}
+
+// Mono and stereo only; other layouts take the scalar loop. Gains come
+// from the frame index, as in the scalar loop, rather than from summing
+// steps, so long ramps do not drift.
+__attribute__((target("sse2"))) static void
+gain_ramp_sse2(float *dst, const float *src, size_t frames, uint32_t channels,
+               float start, float step) {
+  if (channels != 1 && channels != 2) {
+    gain_ramp_scalar(dst, src, frames, channels, start, step);
+    return;
+  }
+
+  // Frame index of each lane, and how far it moves per vector.
+  __m128 index = channels == 1 ? _mm_setr_ps(0, 1, 2, 3)
+                               : _mm_setr_ps(0, 0, 1, 1);
+  __m128 advance = _mm_set1_ps(4.0f / channels);
+  __m128 s = _mm_set1_ps(start);
+  __m128 k = _mm_set1_ps(step);
+  size_t count = frames * channels;
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 gain = _mm_add_ps(s, _mm_mul_ps(k, index));
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), gain));
+    index = _mm_add_ps(index, advance);
+  }
+  size_t done = i / channels;
+  gain_ramp_scalar(dst + i, src + i, frames - done, channels,
+                   start + step * (float)done, step);
+}
+
+__attribute__((target("sse2"))) static void
+mix_add_sse2(float *dst, const float *src, size_t count, float gain) {
+  __m128 g = _mm_set1_ps(gain);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128 a = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+    __m128 b = _mm_mul_ps(_mm_loadu_ps(src + i + 4), g);
+    _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), a));
+    _mm_storeu_ps(dst + i + 4, _mm_add_ps(_mm_loadu_ps(dst + i + 4), b));
+  }
+  mix_add_scalar(dst + i, src + i, count - i, gain);
+}
+
+__attribute__((target("sse2"))) static float
+dot_sse2(const float *a, const float *b, size_t count) {
+  // Two accumulators to keep the adds from serialising.
+  __m128 sum0 = _mm_setzero_ps();
+  __m128 sum1 = _mm_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    sum0 = _mm_add_ps(sum0,
+                      _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    sum1 = _mm_add_ps(
+        sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+  }
+  float lanes[4];
+  _mm_storeu_ps(lanes, _mm_add_ps(sum0, sum1));
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+         dot_scalar(a + i, b + i, count - i);
+}
+
+__attribute__((target("sse2"))) static void
+s16_to_f32_sse2(float *dst, const int16_t *src, size_t count) {
+  __m128 scale = _mm_set1_ps(kS16Scale);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    // Each sample into the top half of a lane, then shifted down with sign.
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+    _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+  }
+  s16_to_f32_scalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("sse2"))) static void
+f32_to_s16_sse2(int16_t *dst, const float *src, size_t count) {
+  // Clamped as floats first: out-of-range conversions come back as INT_MIN,
+  // which the saturating pack would turn into full negative scale.
+  __m128 scale = _mm_set1_ps(32768.0f);
+  __m128 low = _mm_set1_ps(-32768.0f);
+  __m128 high = _mm_set1_ps(32767.0f);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128 a = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+    __m128 b = _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale);
+    a = _mm_min_ps(_mm_max_ps(a, low), high);
+    b = _mm_min_ps(_mm_max_ps(b, low), high);
+    __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), packed);
+  }
+  f32_to_s16_scalar(dst + i, src + i, count - i);
+}
+
+/* ---------------- AVX2 ---------------- */
+
+__attribute__((target("avx2"))) static void
+gain_avx2(float *dst, const float *src, size_t count, float gain) {
+  __m256 g = _mm256_set1_ps(gain);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256 a = _mm256_loadu_ps(src + i);
+    __m256 b = _mm256_loadu_ps(src + i + 8);
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(a, g));
+    _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(b, g));
+  }
+  gain_scalar(dst + i, src + i, count - i, gain);
+}
+
+__attribute__((target("avx2"))) static void
+gain_ramp_avx2(float *dst, const float *src, size_t frames, uint32_t channels,
+               float start, float step) {
+  if (channels != 1 && channels != 2) {
+    gain_ramp_scalar(dst, src, frames, channels, start, step);
+    return;
+  }
+
+  __m256 index = channels == 1 ? _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)
+                               : _mm256_setr_ps(0, 0, 1, 1, 2, 2, 3, 3);
+  __m256 advance = _mm256_set1_ps(8.0f / channels);
+  __m256 s = _mm256_set1_ps(start);
+  __m256 k = _mm256_set1_ps(step);
+  size_t count = frames * channels;
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 gain = _mm256_add_ps(s, _mm256_mul_ps(k, index));
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(src + i), gain));
+    index = _mm256_add_ps(index, advance);
+  }
+  size_t done = i / channels;
+  gain_ramp_scalar(dst + i, src + i, frames - done, channels,
+                   start + step * (float)done, step);
+}
+
+__attribute__((target("avx2"))) static void
+mix_add_avx2(float *dst, const float *src, size_t count, float gain) {
+  __m256 g = _mm256_set1_ps(gain);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256 a = _mm256_mul_ps(_mm256_loadu_ps(src + i), g);
+    __m256 b = _mm256_mul_ps(_mm256_loadu_ps(src + i + 8), g);
+    _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), a));
+    _mm256_storeu_ps(dst + i + 8,
+                     _mm256_add_ps(_mm256_loadu_ps(dst + i + 8), b));
+  }
+  mix_add_scalar(dst + i, src + i, count - i, gain);
+}
+
+__attribute__((target("avx2"))) static float
+dot_avx2(const float *a, const float *b, size_t count) {
+  __m256 sum0 = _mm256_setzero_ps();
+  __m256 sum1 = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    sum0 = _mm256_add_ps(
+        sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8),
+                                             _mm256_loadu_ps(b + i + 8)));
+  }
+  __m256 sum = _mm256_add_ps(sum0, sum1);
+  __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum),
+                           _mm256_extractf128_ps(sum, 1));
+  float lanes[4];
+  _mm_storeu_ps(lanes, half);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+         dot_scalar(a + i, b + i, count - i);
+}
+
+__attribute__((target("avx2"))) static void
+s16_to_f32_avx2(float *dst, const int16_t *src, size_t count) {
+  __m256 scale = _mm256_set1_ps(kS16Scale);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    __m128i b =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 8));
+    __m256 fa = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(a));
+    __m256 fb = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(b));
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(fa, scale));
+    _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(fb, scale));
+  }
+  s16_to_f32_scalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx2"))) static void
+f32_to_s16_avx2(int16_t *dst, const float *src, size_t count) {
+  __m256 scale = _mm256_set1_ps(32768.0f);
+  __m256 low = _mm256_set1_ps(-32768.0f);
+  __m256 high = _mm256_set1_ps(32767.0f);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256 a = _mm256_mul_ps(_mm256_loadu_ps(src + i), scale);
+    __m256 b = _mm256_mul_ps(_mm256_loadu_ps(src + i + 8), scale);
+    a = _mm256_min_ps(_mm256_max_ps(a, low), high);
+    b = _mm256_min_ps(_mm256_max_ps(b, low), high);
+    // The pack works per 128-bit lane; put the quarters back in order.
+    __m256i packed =
+        _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+    packed = _mm256_permute4x64_epi64(packed, 0xD8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+  }
+  f32_to_s16_scalar(dst + i, src + i, count - i);
+}
+
+#endif // JUST_AUDIO_DSP_X86
+
+/* ---------------- dispatch ---------------- */
+
+static const DspKernels kScalarKernels = {
+    DspIsa::kScalar,   "scalar",         gain_scalar,
+    gain_ramp_scalar,  mix_add_scalar,   clear_scalar,
+    dot_scalar,        s16_to_f32_scalar, f32_to_s16_scalar};
+
+#if defined(JUST_AUDIO_DSP_X86)
+static const DspKernels kSse2Kernels = {
+    DspIsa::kSse2,   "sse2",          gain_sse2,
+    gain_ramp_sse2,  mix_add_sse2,    clear_scalar,
+    dot_sse2,        s16_to_f32_sse2, f32_to_s16_sse2};
+
+static const DspKernels kAvx2Kernels = {
+    DspIsa::kAvx2,   "avx2",          gain_avx2,
+    gain_ramp_avx2,  mix_add_avx2,    clear_scalar,
+    dot_avx2,        s16_to_f32_avx2, f32_to_s16_avx2};
+#endif
+
+const DspKernels *DspFor(DspIsa isa) {
+  switch (isa) {
+  case DspIsa::kScalar:
+    return &kScalarKernels;
+#if defined(JUST_AUDIO_DSP_X86)
+  case DspIsa::kSse2:
+    return __builtin_cpu_supports("sse2") ? &kSse2Kernels : nullptr;
+  case DspIsa::kAvx2:
+    // Also false when the OS does not save the upper register halves.
+    return __builtin_cpu_supports("avx2") ? &kAvx2Kernels : nullptr;
+#endif
+  default:
+    return nullptr;
+  }
+}
+
+const DspKernels &Dsp() {
+  static const DspKernels *kernels = []() {
+    for (DspIsa isa : {DspIsa::kAvx2, DspIsa::kSse2}) {
+      if (const DspKernels *candidate = DspFor(isa)) {
+        return candidate;
+      }
+    }
+    return &kScalarKernels;
+  }();
+  return *kernels;
+}
+
+} // namespace just_audio_windows_linux
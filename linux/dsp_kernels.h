@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace just_audio_windows_linux {
+
+/* ---------------- DSP kernels ---------------- */
+
+// Instruction sets a kernel table can be built for, in order of preference.
+enum class DspIsa { kScalar, kSse2, kAvx2 };
+
+// Inner loops shared by the audio callback and anything mixing into it.
+// Counts are in samples unless a kernel says frames, and buffers need no
+// particular alignment. Each table is picked once from what the CPU
+// reports; none of the kernels allocate or block, so they are safe on the
+// device thread.
+struct DspKernels {
+  DspIsa isa;
+  const char *name;
+
+  // dst[i] = src[i] * gain. dst may equal src.
+  void (*gain)(float *dst, const float *src, size_t count, float gain);
+  // Gain moving linearly across interleaved frames: every sample of frame f
+  // is scaled by start + step * f. dst may equal src.
+  void (*gain_ramp)(float *dst, const float *src, size_t frames,
+                    uint32_t channels, float start, float step);
+  // dst[i] += src[i] * gain.
+  void (*mix_add)(float *dst, const float *src, size_t count, float gain);
+  // dst[i] = 0.
+  void (*clear)(float *dst, size_t count);
+  // Sum of a[i] * b[i]. Vector tables add in a different order, so results
+  // differ from the scalar one by rounding.
+  float (*dot)(const float *a, const float *b, size_t count);
+  // Full scale maps to [-1, 1); the way back saturates.
+  void (*s16_to_f32)(float *dst, const int16_t *src, size_t count);
+  void (*f32_to_s16)(int16_t *dst, const float *src, size_t count);
+};
+
+// The best table this CPU runs.
+const DspKernels &Dsp();
+
+// A specific table, or nullptr if this build or CPU cannot run it. Meant
+// for benchmarks and for checking the vector paths against the scalar one.
+const DspKernels *DspFor(DspIsa isa);
+
+} // namespace just_audio_windows_linux
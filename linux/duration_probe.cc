@@ -0,0 +1,286 @@
+#include "duration_probe.h"
+
+#include <cstring>
+
+namespace just_audio_windows_linux {
+
+// How far into the file a first MP3 frame is searched for after any ID3 tag.
+static constexpr size_t kSyncSearchBytes = 64 * 1024;
+// How much of the file tail is searched for the last Ogg page.
+static constexpr size_t kOggTailBytes = 64 * 1024;
+
+static uint32_t read_be32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint32_t read_le32(const uint8_t *p) {
+  return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[1] << 8) | p[0];
+}
+
+static uint64_t read_le64(const uint8_t *p) {
+  return ((uint64_t)read_le32(p + 4) << 32) | read_le32(p);
+}
+
+// Size of a leading ID3v2 tag, or 0 if there is none.
+static size_t id3v2_size(const uint8_t *data, size_t size) {
+  if (size < 10 || memcmp(data, "ID3", 3) != 0) {
+    return 0;
+  }
+  size_t tag = ((size_t)(data[6] & 0x7F) << 21) |
+               ((size_t)(data[7] & 0x7F) << 14) |
+               ((size_t)(data[8] & 0x7F) << 7) | (data[9] & 0x7F);
+  // Footer present.
+  if (data[5] & 0x10) {
+    tag += 10;
+  }
+  return 10 + tag;
+}
+
+/* ---------------- MP3 ---------------- */
+
+struct Mp3Header {
+  uint32_t bitrate = 0; // bits per second
+  uint32_t sample_rate = 0;
+  uint32_t samples_per_frame = 0;
+  bool mpeg1 = false;
+  bool mono = false;
+};
+
+static bool parse_mp3_header(const uint8_t *p, Mp3Header *header) {
+  static const uint16_t kBitratesV1[3][15] = {
+      {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+      {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+      {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320}};
+  static const uint16_t kBitratesV2[2][15] = {
+      {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+      {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}};
+  static const uint32_t kSampleRates[3] = {44100, 48000, 32000};
+
+  if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0) {
+    return false;
+  }
+  int version = (p[1] >> 3) & 3; // 0 = 2.5, 2 = 2, 3 = 1
+  int layer = (p[1] >> 1) & 3;   // 1 = III, 2 = II, 3 = I
+  int bitrate_index = p[2] >> 4;
+  int rate_index = (p[2] >> 2) & 3;
+  if (version == 1 || layer == 0 || bitrate_index == 0 ||
+      bitrate_index == 15 || rate_index == 3) {
+    return false;
+  }
+
+  header->mpeg1 = version == 3;
+  header->mono = (p[3] >> 6) == 3;
+  int layer_row = 3 - layer; // 0 = I, 1 = II, 2 = III
+  uint32_t kbps = header->mpeg1
+                      ? kBitratesV1[layer_row][bitrate_index]
+                      : kBitratesV2[layer_row == 0 ? 0 : 1][bitrate_index];
+  header->bitrate = kbps * 1000;
+  header->sample_rate =
+      kSampleRates[rate_index] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+  header->samples_per_frame =
+      layer_row == 0 ? 384 : (layer_row == 1 || header->mpeg1) ? 1152 : 576;
+  return true;
+}
+
+static bool probe_mp3(const uint8_t *data, size_t size, DurationProbe *out) {
+  size_t start = id3v2_size(data, size);
+  size_t end = size;
+  if (end >= 128 && memcmp(data + end - 128, "TAG", 3) == 0) {
+    end -= 128;
+  }
+
+  // Without an ID3 tag the stream has to open on a frame; anything else is
+  // some other format whose payload happens to contain a sync word.
+  Mp3Header header;
+  if (start >= end) {
+    return false;
+  }
+  if (start == 0 && (end < 4 || !parse_mp3_header(data, &header))) {
+    return false;
+  }
+
+  size_t limit = end - start > kSyncSearchBytes ? start + kSyncSearchBytes
+                                                : end;
+  size_t frame = start;
+  for (; frame + 4 <= limit; ++frame) {
+    if (parse_mp3_header(data + frame, &header)) {
+      break;
+    }
+  }
+  if (frame + 4 > limit) {
+    return false;
+  }
+  out->sample_rate = header.sample_rate;
+
+  // Xing/Info sits right after the side information of the first frame.
+  size_t side_info = header.mpeg1 ? (header.mono ? 17 : 32)
+                                  : (header.mono ? 9 : 17);
+  size_t xing = frame + 4 + side_info;
+  if (xing + 8 <= end && (memcmp(data + xing, "Xing", 4) == 0 ||
+                          memcmp(data + xing, "Info", 4) == 0)) {
+    uint32_t flags = read_be32(data + xing + 4);
+    size_t cursor = xing + 8;
+    if ((flags & 1) && cursor + 4 <= end) {
+      uint64_t frames = read_be32(data + cursor);
+      uint64_t samples = frames * header.samples_per_frame;
+
+      // Optional byte count, TOC and quality, then the LAME tag with the
+      // encoder delay and padding 21 bytes in.
+      cursor += 4;
+      cursor += (flags & 2) ? 4 : 0;
+      cursor += (flags & 4) ? 100 : 0;
+      cursor += (flags & 8) ? 4 : 0;
+      if (cursor + 24 <= end && memcmp(data + cursor, "LAME", 4) == 0) {
+        const uint8_t *gap = data + cursor + 21;
+        uint32_t delay = ((uint32_t)gap[0] << 4) | (gap[1] >> 4);
+        uint32_t padding = ((uint32_t)(gap[1] & 0x0F) << 8) | gap[2];
+        if (delay + padding < samples) {
+          samples -= delay + padding;
+        }
+      }
+      out->frames = samples;
+      return true;
+    }
+  }
+
+  // VBRI always sits 32 bytes after the frame header.
+  size_t vbri = frame + 4 + 32;
+  if (vbri + 18 <= end && memcmp(data + vbri, "VBRI", 4) == 0) {
+    out->frames = (uint64_t)read_be32(data + vbri + 14) *
+                  header.samples_per_frame;
+    return true;
+  }
+
+  // No table of contents: assume the first frame's bitrate holds throughout.
+  out->frames = (uint64_t)(end - frame) * 8 * header.sample_rate /
+                header.bitrate;
+  return true;
+}
+
+/* ---------------- FLAC ---------------- */
+
+static bool probe_flac(const uint8_t *data, size_t size, DurationProbe *out) {
+  size_t start = id3v2_size(data, size);
+  // Marker, block header, then STREAMINFO, which is always first.
+  if (start + 4 + 4 + 18 > size || memcmp(data + start, "fLaC", 4) != 0 ||
+      (data[start + 4] & 0x7F) != 0) {
+    return false;
+  }
+
+  const uint8_t *info = data + start + 8;
+  out->sample_rate = ((uint32_t)info[10] << 12) | ((uint32_t)info[11] << 4) |
+                     (info[12] >> 4);
+  out->frames = ((uint64_t)(info[13] & 0x0F) << 32) | read_be32(info + 14);
+  // A zero count means the encoder did not know it.
+  out->exact = out->frames > 0;
+  return out->sample_rate > 0 && out->frames > 0;
+}
+
+/* ---------------- Ogg ---------------- */
+
+static bool probe_ogg(const uint8_t *data, size_t size, DurationProbe *out) {
+  if (size < 28 || memcmp(data, "OggS", 4) != 0) {
+    return false;
+  }
+
+  // The first page carries the codec identification packet.
+  uint32_t serial = read_le32(data + 14);
+  size_t packet = 27 + data[26];
+  uint64_t pre_skip = 0;
+  if (packet + 19 <= size && memcmp(data + packet, "OpusHead", 8) == 0) {
+    // Opus always decodes at 48 kHz; the first pre_skip samples are dropped.
+    out->sample_rate = 48000;
+    pre_skip = data[packet + 10] | ((uint32_t)data[packet + 11] << 8);
+  } else if (packet + 16 <= size &&
+             memcmp(data + packet, "\x01vorbis", 7) == 0) {
+    out->sample_rate = read_le32(data + packet + 12);
+  } else {
+    return false;
+  }
+
+  // The last page of the stream holds the final granule position.
+  size_t tail = size > kOggTailBytes ? size - kOggTailBytes : 0;
+  for (size_t page = size - 27 + 1; page-- > tail;) {
+    if (memcmp(data + page, "OggS", 4) != 0 || data[page + 4] != 0 ||
+        read_le32(data + page + 14) != serial) {
+      continue;
+    }
+    uint64_t granule = read_le64(data + page + 6);
+    if (granule == UINT64_MAX) {
+      continue;
+    }
+    out->frames = granule > pre_skip ? granule - pre_skip : 0;
+    return out->sample_rate > 0 && out->frames > 0;
+  }
+  return false;
+}
+
+/* ---------------- format sniffing ---------------- */
+
+AudioFormat SniffFormat(const void *data, size_t size) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  auto at = [&](size_t offset, const char *signature) {
+    size_t length = strlen(signature);
+    return offset + length <= size &&
+           memcmp(bytes + offset, signature, length) == 0;
+  };
+
+  if ((at(0, "RIFF") || at(0, "RIFX") || at(0, "RF64")) && at(8, "WAVE")) {
+    return AudioFormat::kWav;
+  }
+  // Wave64 opens on a GUID that starts with "riff".
+  if (at(0, "riff") || (at(0, "FORM") && (at(8, "AIFF") || at(8, "AIFC")))) {
+    return AudioFormat::kWav;
+  }
+  if (at(0, "fLaC")) {
+    return AudioFormat::kFlac;
+  }
+
+  // The codec identification packet opens the first page.
+  if (at(0, "OggS") && size >= 27) {
+    size_t packet = 27 + bytes[26];
+    if (at(packet, "OpusHead")) {
+      return AudioFormat::kOpus;
+    }
+    if (at(packet, "\x01vorbis")) {
+      return AudioFormat::kVorbis;
+    }
+    if (at(packet, "\x7f" "FLAC")) {
+      return AudioFormat::kFlac;
+    }
+    return AudioFormat::kUnknown;
+  }
+
+  // Some FLAC encoders put an ID3 tag in front too.
+  size_t tag = id3v2_size(bytes, size);
+  if (tag > 0) {
+    return at(tag, "fLaC") ? AudioFormat::kFlac : AudioFormat::kMp3;
+  }
+  Mp3Header header;
+  if (size >= 4 && parse_mp3_header(bytes, &header)) {
+    return AudioFormat::kMp3;
+  }
+  return AudioFormat::kUnknown;
+}
+
+/* ---------------- entry point ---------------- */
+
+bool ProbeDuration(const void *data, size_t size, DurationProbe *out) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  *out = DurationProbe();
+
+  if (probe_flac(bytes, size, out) || probe_ogg(bytes, size, out)) {
+    return true;
+  }
+  *out = DurationProbe();
+
+  if (probe_mp3(bytes, size, out)) {
+    return true;
+  }
+  *out = DurationProbe();
+  return false;
+}
+
+} // namespace just_audio_windows_linux
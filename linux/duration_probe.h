@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace just_audio_windows_linux {
+
+/* ---------------- duration probe ---------------- */
+
+// Length read from container metadata without decoding: MP3 Xing/Info (with
+// the LAME delay and padding), VBRI or a CBR bitrate estimate, FLAC
+// STREAMINFO, or the last Ogg granule position for Opus and Vorbis.
+struct DurationProbe {
+  uint64_t frames = 0;
+  uint32_t sample_rate = 0;
+  // Set when the header states the length outright (FLAC STREAMINFO).
+  // Everything else may be off and wants a decoder to confirm it.
+  bool exact = false;
+};
+
+// Looks only at the start and end of the file image. Returns false for
+// formats it does not know or headers that do not parse.
+bool ProbeDuration(const void *data, size_t size, DurationProbe *out);
+
+/* ---------------- format sniffing ---------------- */
+
+// Which decoder a file wants, going by its signature.
+enum class AudioFormat {
+  kUnknown,
+  // RIFF/RIFX/RF64 WAVE, Wave64 and AIFF, all read by the WAV decoder.
+  kWav,
+  // Native FLAC, also behind an ID3 tag, and FLAC in Ogg.
+  kFlac,
+  // An ID3 tag or an MPEG audio frame header.
+  kMp3,
+  kOpus,
+  kVorbis,
+};
+
+// How much of the start of a file SniffFormat() looks at. A FLAC file
+// behind an ID3 tag longer than this is taken for an MP3.
+constexpr size_t kSniffBytes = 4096;
+
+// data holds the first kSniffBytes of the file, or all of it if shorter;
+// more is fine.
+AudioFormat SniffFormat(const void *data, size_t size);
+
+} // namespace just_audio_windows_linux
@@ -0,0 +1,112 @@
+#include "event_encoder.h"
+
+#include <cstring>
+
+namespace just_audio_windows_linux {
+
+EventEncoder::EventEncoder(EventEncoding encoding,
+                           std::initializer_list<Field> fields)
+    : encoding_(encoding) {
+  for (const Field &field : fields) {
+    Slot slot;
+    slot.field = field;
+    slot.key = fl_value_new_string(field.key);
+    slots_.push_back(slot);
+  }
+  map_ = fl_value_new_map();
+  packed_.resize(slots_.size() * sizeof(int64_t));
+}
+
+EventEncoder::~EventEncoder() {
+  fl_value_unref(map_);
+  for (Slot &slot : slots_) {
+    fl_value_unref(slot.key);
+    if (slot.value != nullptr) {
+      fl_value_unref(slot.value);
+    }
+  }
+}
+
+/* ---------------- field values ---------------- */
+
+void EventEncoder::Set(size_t field, int64_t bits) {
+  Slot &slot = slots_[field];
+  if (slot.value == nullptr || slot.bits != bits) {
+    slot.bits = bits;
+    slot.changed = true;
+  }
+}
+
+void EventEncoder::set_int(size_t field, int64_t value) { Set(field, value); }
+
+void EventEncoder::set_bool(size_t field, bool value) {
+  Set(field, value ? 1 : 0);
+}
+
+void EventEncoder::set_float(size_t field, double value) {
+  int64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  Set(field, bits);
+}
+
+FlValue *EventEncoder::NewValue(const Slot &slot) const {
+  switch (slot.field.type) {
+  case FL_VALUE_TYPE_BOOL:
+    return fl_value_new_bool(slot.bits != 0);
+  case FL_VALUE_TYPE_FLOAT: {
+    double value;
+    std::memcpy(&value, &slot.bits, sizeof(value));
+    return fl_value_new_float(value);
+  }
+  default:
+    return fl_value_new_int(slot.bits);
+  }
+}
+
+/* ---------------- encoding ---------------- */
+
+FlValue *EventEncoder::Encode() {
+  if (encoding_ == EventEncoding::kBinary) {
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      uint64_t bits = (uint64_t)slots_[i].bits;
+      for (size_t b = 0; b < sizeof(bits); ++b) {
+        packed_[i * sizeof(bits) + b] = (uint8_t)(bits >> (8 * b));
+      }
+      slots_[i].changed = false;
+    }
+    return fl_value_new_uint8_list(packed_.data(), packed_.size());
+  }
+
+  if (encoding_ == EventEncoding::kDiff) {
+    bool worth_sending = false;
+    for (const Slot &slot : slots_) {
+      worth_sending |= slot.changed && !slot.field.is_volatile;
+    }
+    if (!worth_sending) {
+      return nullptr;
+    }
+  }
+
+  FlValue *diff =
+      encoding_ == EventEncoding::kDiff ? fl_value_new_map() : nullptr;
+  for (Slot &slot : slots_) {
+    if (!slot.changed) {
+      continue;
+    }
+    slot.changed = false;
+    if (slot.value != nullptr) {
+      fl_value_unref(slot.value);
+    }
+    slot.value = NewValue(slot);
+
+    // Replaces the value in place; the key object is the one already there.
+    fl_value_set(map_, slot.key, slot.value);
+    if (diff != nullptr) {
+      fl_value_set(diff, slot.key, slot.value);
+    }
+  }
+
+  return diff != nullptr ? diff : fl_value_ref(map_);
+}
+
+} // namespace just_audio_windows_linux
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <flutter_linux/flutter_linux.h>
+
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+namespace just_audio_windows_linux {
+
+/* ---------------- EventEncoding ---------------- */
+
+// How event and data channel messages are laid out, chosen at init.
+enum class EventEncoding {
+  // Every field, every time, as a map; what just_audio expects.
+  kFull,
+  // A map of the fields that changed since the previous message; the
+  // receiver merges it into what it has. The first message is complete.
+  kDiff,
+  // Every field packed into one Uint8List, 8 little-endian bytes each in
+  // declaration order: integers and bools as int64, floats as float64.
+  kBinary,
+};
+
+/* ---------------- EventEncoder ---------------- */
+
+// Builds the messages for one event channel. Keys are made once, the full
+// map is kept and only has the values that changed replaced, and diff
+// messages share those value objects, so steady-state events allocate
+// little more than the changed values. Main thread only.
+class EventEncoder {
+public:
+  struct Field {
+    const char *key;
+    FlValueType type;
+    // Changes to a volatile field (a timestamp, say) are not worth a
+    // message of their own; they ride along with any other change.
+    bool is_volatile = false;
+  };
+
+  EventEncoder(EventEncoding encoding, std::initializer_list<Field> fields);
+  ~EventEncoder();
+
+  EventEncoder(const EventEncoder &) = delete;
+  EventEncoder &operator=(const EventEncoder &) = delete;
+
+  // Field values for the next message, by index into the declaration.
+  void set_int(size_t field, int64_t value);
+  void set_bool(size_t field, bool value);
+  void set_float(size_t field, double value);
+
+  // The message for the values set since the last call, as a new reference,
+  // or nullptr when a diff would carry nothing worth sending.
+  FlValue *Encode();
+
+private:
+  struct Slot {
+    Field field;
+    FlValue *key = nullptr;
+    // Current value object, shared by every map that carries it.
+    FlValue *value = nullptr;
+    int64_t bits = 0;
+    bool changed = true;
+  };
+
+  void Set(size_t field, int64_t bits);
+  FlValue *NewValue(const Slot &slot) const;
+
+  EventEncoding encoding_;
+  std::vector<Slot> slots_;
+  FlValue *map_ = nullptr;
+  std::vector<uint8_t> packed_;
+};
+
+} // namespace just_audio_windows_linux
@@ -3,11 +3,16 @@
 #include <flutter_linux/flutter_linux.h>
 #include <gtk/gtk.h>
 
+#include <cstdlib>
 #include <cstring>
+#include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
+#include "audio_engine.h"
 #include "audio_player.h"
+#include "pcm_cache.h"
 #include <iostream>
 #define JUST_AUDIO_WINDOWS_LINUX_PLUGIN(obj)                                   \
   (G_TYPE_CHECK_INSTANCE_CAST((obj),                                           \
@@ -22,9 +27,181 @@ struct _JustAudioWindowsLinuxPlugin {
 G_DEFINE_TYPE(JustAudioWindowsLinuxPlugin, just_audio_windows_linux_plugin,
               g_object_get_type())
 
-/* ---------------- Global player (same behavior as Windows) ---------------- */
+/* ---------------- Players ---------------- */
 
-static std::unique_ptr<just_audio_windows_linux::AudioPlayer> player;
+// Every live player by id. Each owns its channels and its ring; the engine
+// mixes whichever of them are playing into the one device.
+static std::map<std::string,
+                std::unique_ptr<just_audio_windows_linux::AudioPlayer>>
+    players;
+
+/* ---------------- Init options ---------------- */
+
+// Reads an optional non-negative integer option; missing or malformed keys
+// leave *out untouched. Returns whether the key was applied.
+static bool lookup_int_option(FlValue *args, const char *key, int64_t *out) {
+  FlValue *value = fl_value_lookup_string(args, key);
+  if (value == nullptr || fl_value_get_type(value) != FL_VALUE_TYPE_INT ||
+      fl_value_get_int(value) < 0) {
+    return false;
+  }
+  *out = fl_value_get_int(value);
+  return true;
+}
+
+// Reads an optional boolean option; anything but a bool leaves *out as is.
+static bool lookup_bool_option(FlValue *args, const char *key, bool *out) {
+  FlValue *value = fl_value_lookup_string(args, key);
+  if (value == nullptr || fl_value_get_type(value) != FL_VALUE_TYPE_BOOL) {
+    return false;
+  }
+  *out = fl_value_get_bool(value);
+  return true;
+}
+
+static just_audio_windows_linux::AudioPlayerOptions
+parse_player_options(FlValue *args) {
+  just_audio_windows_linux::AudioPlayerOptions options;
+
+  int64_t buffer_ms = 0;
+  if (lookup_int_option(args, "decodeBufferMs", &buffer_ms) && buffer_ms > 0) {
+    options.decode_buffer_ms = (ma_uint32)buffer_ms;
+  }
+  lookup_bool_option(args, "nativeOutput", &options.native_output);
+
+  // "full" (the default), "diff" or "binary"; anything else keeps full maps.
+  FlValue *encoding = fl_value_lookup_string(args, "eventEncoding");
+  if (encoding != nullptr &&
+      fl_value_get_type(encoding) == FL_VALUE_TYPE_STRING) {
+    const char *name = fl_value_get_string(encoding);
+    if (strcmp(name, "diff") == 0) {
+      options.event_encoding = just_audio_windows_linux::EventEncoding::kDiff;
+    } else if (strcmp(name, "binary") == 0) {
+      options.event_encoding =
+          just_audio_windows_linux::EventEncoding::kBinary;
+    }
+  }
+
+  // "pitchPreserving" (the default) or "varispeed".
+  FlValue *speed_mode = fl_value_lookup_string(args, "speedMode");
+  if (speed_mode != nullptr &&
+      fl_value_get_type(speed_mode) == FL_VALUE_TYPE_STRING &&
+      strcmp(fl_value_get_string(speed_mode), "varispeed") == 0) {
+    options.speed_mode = just_audio_windows_linux::SpeedMode::kVarispeed;
+  }
+
+  return options;
+}
+
+// The decoded-clip cache is process wide; the latest init that names either
+// key reconfigures it.
+static void configure_pcm_cache(FlValue *args) {
+  just_audio_windows_linux::PcmCache &cache =
+      just_audio_windows_linux::PcmCache::Instance();
+  int64_t budget_bytes = (int64_t)cache.budget_bytes();
+  int64_t max_clip_ms = cache.max_clip_ms();
+  bool has_budget = lookup_int_option(args, "pcmCacheBytes", &budget_bytes);
+  bool has_clip = lookup_int_option(args, "pcmCacheMaxClipMs", &max_clip_ms);
+  if (has_budget || has_clip) {
+    cache.Configure((size_t)budget_bytes, (ma_uint32)max_clip_ms);
+  }
+}
+
+// The device is shared too; "latencyProfile" ("default", "lowLatency" or
+// "powerSaving") and "periodMs" set how it is opened. Each load reports
+// what the backend granted.
+static void configure_output_latency(FlValue *args) {
+  FlValue *profile = fl_value_lookup_string(args, "latencyProfile");
+  FlValue *period = fl_value_lookup_string(args, "periodMs");
+  if (profile == nullptr && period == nullptr) {
+    // Leaves the engine alone: it may still be opening the device.
+    return;
+  }
+
+  just_audio_windows_linux::AudioEngine &engine =
+      just_audio_windows_linux::AudioEngine::Instance();
+  just_audio_windows_linux::OutputLatency latency = engine.latency();
+  bool has_option = false;
+
+  if (profile != nullptr &&
+      fl_value_get_type(profile) == FL_VALUE_TYPE_STRING) {
+    const char *name = fl_value_get_string(profile);
+    if (strcmp(name, "lowLatency") == 0) {
+      latency.profile = just_audio_windows_linux::LatencyProfile::kLowLatency;
+    } else if (strcmp(name, "powerSaving") == 0) {
+      latency.profile = just_audio_windows_linux::LatencyProfile::kPowerSaving;
+    } else {
+      latency.profile = just_audio_windows_linux::LatencyProfile::kDefault;
+    }
+    has_option = true;
+  }
+
+  int64_t period_ms = latency.period_ms;
+  if (lookup_int_option(args, "periodMs", &period_ms)) {
+    latency.period_ms = (ma_uint32)period_ms;
+    has_option = true;
+  }
+
+  // Players already playing keep the old periods until the device is next
+  // reopened.
+  if (has_option) {
+    engine.SetLatency(latency);
+  }
+}
+
+/* ---------------- Backends ---------------- */
+
+// Which backends the engine tries, in order, from $JUST_AUDIO_BACKENDS: a
+// comma-separated list of "pulseaudio" (also what PipeWire serves), "alsa",
+// "jack" and "null", or "all" for every real backend miniaudio was built
+// with. Unknown names are skipped. Unset, it is PulseAudio, then ALSA, which
+// keeps the rarer backends from being probed first. The silent null backend
+// is only used when named: falling back to it would make playback appear to
+// work with no sound, where failing the load says what is wrong.
+static std::vector<ma_backend> configured_backends() {
+  static const std::map<std::string, ma_backend> kNames = {
+      {"pulseaudio", ma_backend_pulseaudio},
+      {"pipewire", ma_backend_pulseaudio},
+      {"alsa", ma_backend_alsa},
+      {"jack", ma_backend_jack},
+      {"null", ma_backend_null}};
+
+  const std::vector<ma_backend> kDefault = {ma_backend_pulseaudio,
+                                            ma_backend_alsa};
+
+  const char *list = getenv("JUST_AUDIO_BACKENDS");
+  if (list == nullptr || *list == '\0') {
+    return kDefault;
+  }
+
+  std::vector<ma_backend> backends;
+  std::string names = list;
+  size_t start = 0;
+  while (start <= names.size()) {
+    size_t end = names.find(',', start);
+    if (end == std::string::npos) {
+      end = names.size();
+    }
+    std::string name = names.substr(start, end - start);
+    if (name == "all") {
+      ma_backend enabled[MA_BACKEND_COUNT];
+      size_t count = 0;
+      ma_get_enabled_backends(enabled, MA_BACKEND_COUNT, &count);
+      for (size_t i = 0; i < count; ++i) {
+        if (enabled[i] != ma_backend_null) {
+          backends.push_back(enabled[i]);
+        }
+      }
+    }
+    auto backend = kNames.find(name);
+    if (backend != kNames.end()) {
+      backends.push_back(backend->second);
+    }
+    start = end + 1;
+  }
+  // An empty list would have the engine probe everything, null included.
+  return backends.empty() ? kDefault : backends;
+}
 
 /* ---------------- Method handler ---------------- */
 
@@ -50,16 +227,18 @@ static void just_audio_windows_linux_plugin_handle_method_call(
       return;
     }
 
-    if (player) {
+    const char *id = fl_value_get_string(id_value);
+    if (players.count(id) != 0) {
       fl_method_call_respond_error(method_call, "error",
-                                   "only support one player", nullptr, nullptr);
+                                   "player id already in use", nullptr,
+                                   nullptr);
       return;
     }
 
-    const char *id = fl_value_get_string(id_value);
-
-    player = std::make_unique<just_audio_windows_linux::AudioPlayer>(
-        id, self->messenger);
+    configure_pcm_cache(args);
+    configure_output_latency(args);
+    players[id] = std::make_unique<just_audio_windows_linux::AudioPlayer>(
+        id, self->messenger, parse_player_options(args));
 
     fl_method_call_respond_success(method_call, nullptr, nullptr);
     return;
@@ -67,14 +246,21 @@ static void just_audio_windows_linux_plugin_handle_method_call(
 
   /* -------- disposePlayer -------- */
   if (strcmp(method, "disposePlayer") == 0) {
-    player.reset();
+    FlValue *id_value = args != nullptr &&
+                                fl_value_get_type(args) == FL_VALUE_TYPE_MAP
+                            ? fl_value_lookup_string(args, "id")
+                            : nullptr;
+    if (id_value != nullptr &&
+        fl_value_get_type(id_value) == FL_VALUE_TYPE_STRING) {
+      players.erase(fl_value_get_string(id_value));
+    }
     fl_method_call_respond_success(method_call, fl_value_new_map(), nullptr);
     return;
   }
 
   /* -------- disposeAllPlayers -------- */
   if (strcmp(method, "disposeAllPlayers") == 0) {
-    player.reset();
+    players.clear();
     fl_method_call_respond_success(method_call, fl_value_new_map(), nullptr);
     return;
   }
@@ -85,7 +271,7 @@ static void just_audio_windows_linux_plugin_handle_method_call(
 /* ---------------- GObject lifecycle ---------------- */
 
 static void just_audio_windows_linux_plugin_dispose(GObject *object) {
-  player.reset();
+  players.clear();
   G_OBJECT_CLASS(just_audio_windows_linux_plugin_parent_class)->dispose(object);
 }
 
@@ -134,4 +320,11 @@ void just_audio_windows_linux_plugin_register_with_registrar(
       channel, method_call_cb, g_object_ref(plugin), g_object_unref);
 
   g_object_unref(plugin);
+
+  // Opens the context and device while the app starts up, rather than on
+  // the first load; a load that comes sooner waits for it inside Init().
+  just_audio_windows_linux::AudioEngine &engine =
+      just_audio_windows_linux::AudioEngine::Instance();
+  engine.SetBackends(configured_backends());
+  engine.WarmUp();
 }
@@ -0,0 +1,108 @@
+#include "load_trace.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace just_audio_windows_linux {
+
+static long current_thread() { return (long)syscall(SYS_gettid); }
+
+static int64_t to_us(LoadTrace::Clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+// Quotes and escapes s as a JSON string.
+static std::string json_string(const std::string &s) {
+  std::string out = "\"";
+  for (unsigned char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += (char)c;
+    } else if (c < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out += escaped;
+    } else {
+      out += (char)c;
+    }
+  }
+  return out + "\"";
+}
+
+/* ---------------- trace file ---------------- */
+
+// The one file every player's loads go to, opened on first use.
+class TraceFile {
+public:
+  static TraceFile &Instance() {
+    static TraceFile file;
+    return file;
+  }
+
+  std::mutex &mutex() { return mutex_; }
+  FILE *file() const { return file_; }
+
+private:
+  TraceFile() {
+    const char *path = getenv("JUST_AUDIO_TRACE_FILE");
+    if (path == nullptr || *path == '\0') {
+      return;
+    }
+    file_ = std::fopen(path, "w");
+    if (file_ != nullptr) {
+      std::fputs("[\n", file_);
+      std::fflush(file_);
+    }
+  }
+
+  ~TraceFile() {
+    if (file_ != nullptr) {
+      std::fclose(file_);
+    }
+  }
+
+  std::mutex mutex_;
+  FILE *file_ = nullptr;
+};
+
+static void write_event(FILE *file, const char *name, int64_t start_us,
+                        int64_t duration_us, long thread,
+                        const std::string &label) {
+  std::fprintf(file,
+               "{\"name\":\"%s\",\"cat\":\"load\",\"ph\":\"X\",\"ts\":%lld,"
+               "\"dur\":%lld,\"pid\":%d,\"tid\":%ld,\"args\":{\"load\":%s}},\n",
+               name, (long long)start_us, (long long)duration_us, (int)getpid(),
+               thread, json_string(label).c_str());
+}
+
+/* ---------------- LoadTrace ---------------- */
+
+void LoadTrace::Add(const char *name, Clock::time_point start,
+                    Clock::time_point end) {
+  spans_.push_back(Span{name, start, end, current_thread()});
+}
+
+void LoadTrace::Export(const std::string &label, Clock::time_point end) const {
+  TraceFile &trace_file = TraceFile::Instance();
+  if (trace_file.file() == nullptr) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(trace_file.mutex());
+  FILE *file = trace_file.file();
+  write_event(file, "load", to_us(begin_), to_us(end) - to_us(begin_),
+              current_thread(), label);
+  for (const Span &span : spans_) {
+    write_event(file, span.name, to_us(span.start),
+                to_us(span.end) - to_us(span.start), span.thread, label);
+  }
+  std::fflush(file);
+}
+
+} // namespace just_audio_windows_linux
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace just_audio_windows_linux {
+
+/* ---------------- LoadTrace ---------------- */
+
+// When each stage of one load started and ended, from the method call to
+// READY. The stages run on the main and loader threads, but one after the
+// other, with the trace handed along inside the job; it needs no locking.
+class LoadTrace {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Span {
+    // A string literal naming the stage.
+    const char *name;
+    Clock::time_point start;
+    Clock::time_point end;
+    long thread;
+  };
+
+  // Times a stage from construction to destruction. A null trace makes it
+  // a no-op, so callees can take the trace as an optional pointer.
+  class Scope {
+  public:
+    Scope(LoadTrace *trace, const char *name)
+        : trace_(trace), name_(name),
+          start_(trace != nullptr ? Clock::now() : Clock::time_point()) {}
+    ~Scope() {
+      if (trace_ != nullptr) {
+        trace_->Add(name_, start_, Clock::now());
+      }
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    LoadTrace *trace_;
+    const char *name_;
+    Clock::time_point start_;
+  };
+
+  LoadTrace() : begin_(Clock::now()) {}
+
+  void Add(const char *name, Clock::time_point start, Clock::time_point end);
+
+  Clock::time_point begin() const { return begin_; }
+  const std::vector<Span> &spans() const { return spans_; }
+
+  // Appends the spans, and one covering the whole load up to `end`, as
+  // Chrome trace events to the file named by $JUST_AUDIO_TRACE_FILE. Does
+  // nothing when it is unset. The file is truncated by the first export of
+  // the process and left without its closing bracket, which the trace
+  // viewers accept, so every later load can still be appended.
+  void Export(const std::string &label, Clock::time_point end) const;
+
+private:
+  Clock::time_point begin_;
+  std::vector<Span> spans_;
+};
+
+} // namespace just_audio_windows_linux
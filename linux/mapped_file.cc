@@ -0,0 +1,67 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace just_audio_windows_linux {
+
+/* ---------------- open / close ---------------- */
+
+std::shared_ptr<MappedFile> MappedFile::Open(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+    close(fd);
+    return nullptr;
+  }
+
+  void *data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps the file alive on its own.
+  close(fd);
+  if (data == MAP_FAILED) {
+    return nullptr;
+  }
+
+  std::shared_ptr<MappedFile> file(new MappedFile());
+  file->data_ = data;
+  file->size_ = (size_t)st.st_size;
+  file->AdviseSequential();
+  return file;
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+  }
+}
+
+/* ---------------- access hints ---------------- */
+
+void MappedFile::AdviseSequential() {
+  madvise(data_, size_, MADV_SEQUENTIAL);
+}
+
+void MappedFile::AdviseRandom() { madvise(data_, size_, MADV_RANDOM); }
+
+void MappedFile::WillNeed(size_t offset, size_t length) {
+  if (offset >= size_) {
+    return;
+  }
+  if (length > size_ - offset) {
+    length = size_ - offset;
+  }
+
+  // madvise wants a page-aligned start.
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t aligned = offset - offset % page;
+  madvise(static_cast<char *>(data_) + aligned, length + (offset - aligned),
+          MADV_WILLNEED);
+}
+
+} // namespace just_audio_windows_linux
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace just_audio_windows_linux {
+
+/* ---------------- MappedFile ---------------- */
+
+// Read-only mmap of a local file, handed to decoders as a memory block so
+// reads and seeks are plain pointer arithmetic instead of stdio calls. The
+// advise methods forward access-pattern hints to the kernel; they are best
+// effort and never fail.
+class MappedFile {
+public:
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // Maps path in full. Returns nullptr for anything that cannot be mapped
+  // (missing, empty, not a regular file); callers fall back to file IO.
+  static std::shared_ptr<MappedFile> Open(const std::string &path);
+
+  const void *data() const { return data_; }
+  size_t size() const { return size_; }
+
+  // Linear playback: aggressive readahead, pages behind the cursor may go.
+  void AdviseSequential();
+
+  // Scrubbing: turn readahead off so each jump faults only what it touches.
+  void AdviseRandom();
+
+  // Starts reading [offset, offset + length) in so a seek there does not
+  // block on the disk. The range is clamped to the mapping.
+  void WillNeed(size_t offset, size_t length);
+
+private:
+  MappedFile() = default;
+
+  void *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+} // namespace just_audio_windows_linux
@@ -110,6 +110,54 @@ static long ma_libvorbis_vf_callback__tell(void* pUserData)
 }
 #endif
 
+static ma_result ma_libvorbis_memory__read(void* pUserData, void* pBufferOut, size_t bytesToRead, size_t* pBytesRead)
+{
+    ma_libvorbis* pVorbis = (ma_libvorbis*)pUserData;
+    size_t bytesRemaining;
+
+    bytesRemaining = pVorbis->memorySize - pVorbis->memoryCursor;
+    if (bytesToRead > bytesRemaining) {
+        bytesToRead = bytesRemaining;
+    }
+
+    if (bytesToRead > 0) {
+        memcpy(pBufferOut, pVorbis->pMemory + pVorbis->memoryCursor, bytesToRead);
+        pVorbis->memoryCursor += bytesToRead;
+    }
+
+    *pBytesRead = bytesToRead;
+    return bytesToRead == 0 ? MA_AT_END : MA_SUCCESS;
+}
+
+static ma_result ma_libvorbis_memory__seek(void* pUserData, ma_int64 offset, ma_seek_origin origin)
+{
+    ma_libvorbis* pVorbis = (ma_libvorbis*)pUserData;
+    ma_int64 base;
+
+    if (origin == ma_seek_origin_start) {
+        base = 0;
+    } else if (origin == ma_seek_origin_end) {
+        base = (ma_int64)pVorbis->memorySize;
+    } else {
+        base = (ma_int64)pVorbis->memoryCursor;
+    }
+
+    if (base + offset < 0 || base + offset > (ma_int64)pVorbis->memorySize) {
+        return MA_BAD_SEEK;
+    }
+
+    pVorbis->memoryCursor = (size_t)(base + offset);
+    return MA_SUCCESS;
+}
+
+static ma_result ma_libvorbis_memory__tell(void* pUserData, ma_int64* pCursor)
+{
+    ma_libvorbis* pVorbis = (ma_libvorbis*)pUserData;
+
+    *pCursor = (ma_int64)pVorbis->memoryCursor;
+    return MA_SUCCESS;
+}
+
 static ma_result ma_libvorbis_init_internal(const ma_decoding_backend_config* pConfig, const ma_allocation_callbacks* pAllocationCallbacks, ma_libvorbis* pVorbis)
 {
     if (pVorbis == NULL) {
@@ -155,26 +203,8 @@ static ma_result ma_libvorbis_init_internal(const ma_decoding_backend_config* pC
     #endif
 }
 
-MA_API ma_result ma_libvorbis_init(ma_read_proc onRead, ma_seek_proc onSeek, ma_tell_proc onTell, void* pReadSeekTellUserData, const ma_decoding_backend_config* pConfig, const ma_allocation_callbacks* pAllocationCallbacks, ma_libvorbis* pVorbis)
+static ma_result ma_libvorbis_open_callbacks_internal(const ma_allocation_callbacks* pAllocationCallbacks, ma_libvorbis* pVorbis)
 {
-    ma_result result;
-
-    (void)pAllocationCallbacks; /* Can't seem to find a way to configure memory allocations in libvorbis. */
-
-    if (onRead == NULL || onSeek == NULL) {
-        return MA_INVALID_ARGS; /* onRead and onSeek are mandatory. */
-    }
-    
-    result = ma_libvorbis_init_internal(pConfig, pAllocationCallbacks, pVorbis);
-    if (result != MA_SUCCESS) {
-        return result;
-    }
-
-    pVorbis->onRead = onRead;
-    pVorbis->onSeek = onSeek;
-    pVorbis->onTell = onTell;
-    pVorbis->pReadSeekTellUserData = pReadSeekTellUserData;
-
     #if !defined(MA_NO_LIBVORBIS)
     {
         int libvorbisResult;
@@ -198,11 +228,64 @@ MA_API ma_result ma_libvorbis_init(ma_read_proc onRead, ma_seek_proc onSeek, ma_
     #else
     {
         /* libvorbis is disabled. */
+        (void)pAllocationCallbacks;
+        (void)pVorbis;
         return MA_NOT_IMPLEMENTED;
     }
     #endif
 }
 
+MA_API ma_result ma_libvorbis_init(ma_read_proc onRead, ma_seek_proc onSeek, ma_tell_proc onTell, void* pReadSeekTellUserData, const ma_decoding_backend_config* pConfig, const ma_allocation_callbacks* pAllocationCallbacks, ma_libvorbis* pVorbis)
+{
+    ma_result result;
+
+    (void)pAllocationCallbacks; /* Can't seem to find a way to configure memory allocations in libvorbis. */
+
+    if (onRead == NULL || onSeek == NULL) {
+        return MA_INVALID_ARGS; /* onRead and onSeek are mandatory. */
+    }
+    
+    result = ma_libvorbis_init_internal(pConfig, pAllocationCallbacks, pVorbis);
+    if (result != MA_SUCCESS) {
+        return result;
+    }
+
+    pVorbis->onRead = onRead;
+    pVorbis->onSeek = onSeek;
+    pVorbis->onTell = onTell;
+    pVorbis->pReadSeekTellUserData = pReadSeekTellUserData;
+
+    return ma_libvorbis_open_callbacks_internal(pAllocationCallbacks, pVorbis);
+}
+
+MA_API ma_result ma_libvorbis_init_memory(const void* pData, size_t dataSize, const ma_decoding_backend_config* pConfig, const ma_allocation_callbacks* pAllocationCallbacks, ma_libvorbis* pVorbis)
+{
+    ma_result result;
+
+    (void)pAllocationCallbacks; /* Can't seem to find a way to configure memory allocations in libvorbis. */
+
+    if (pData == NULL || dataSize == 0) {
+        return MA_INVALID_ARGS;
+    }
+
+    result = ma_libvorbis_init_internal(pConfig, pAllocationCallbacks, pVorbis);
+    if (result != MA_SUCCESS) {
+        return result;
+    }
+
+    /* Reads are served straight out of the caller's buffer, so it must outlive the decoder. */
+    pVorbis->pMemory = (const ma_uint8*)pData;
+    pVorbis->memorySize = dataSize;
+    pVorbis->memoryCursor = 0;
+
+    pVorbis->onRead = ma_libvorbis_memory__read;
+    pVorbis->onSeek = ma_libvorbis_memory__seek;
+    pVorbis->onTell = ma_libvorbis_memory__tell;
+    pVorbis->pReadSeekTellUserData = pVorbis;
+
+    return ma_libvorbis_open_callbacks_internal(pAllocationCallbacks, pVorbis);
+}
+
 MA_API ma_result ma_libvorbis_init_file(const char* pFilePath, const ma_decoding_backend_config* pConfig, const ma_allocation_callbacks* pAllocationCallbacks, ma_libvorbis* pVorbis)
 {
     ma_result result;
@@ -564,6 +647,29 @@ static ma_result ma_decoding_backend_init_file__libvorbis(void* pUserData, const
     return MA_SUCCESS;
 }
 
+static ma_result ma_decoding_backend_init_memory__libvorbis(void* pUserData, const void* pData, size_t dataSize, const ma_decoding_backend_config* pConfig, const ma_allocation_callbacks* pAllocationCallbacks, ma_data_source** ppBackend)
+{
+    ma_result result;
+    ma_libvorbis* pVorbis;
+
+    (void)pUserData;
+
+    pVorbis = (ma_libvorbis*)ma_malloc(sizeof(*pVorbis), pAllocationCallbacks);
+    if (pVorbis == NULL) {
+        return MA_OUT_OF_MEMORY;
+    }
+
+    result = ma_libvorbis_init_memory(pData, dataSize, pConfig, pAllocationCallbacks, pVorbis);
+    if (result != MA_SUCCESS) {
+        ma_free(pVorbis, pAllocationCallbacks);
+        return result;
+    }
+
+    *ppBackend = pVorbis;
+
+    return MA_SUCCESS;
+}
+
 static void ma_decoding_backend_uninit__libvorbis(void* pUserData, ma_data_source* pBackend, const ma_allocation_callbacks* pAllocationCallbacks)
 {
     ma_libvorbis* pVorbis = (ma_libvorbis*)pBackend;
@@ -580,7 +686,7 @@ static ma_decoding_backend_vtable ma_gDecodingBackendVTable_libvorbis =
     ma_decoding_backend_init__libvorbis,
     ma_decoding_backend_init_file__libvorbis,
     NULL, /* onInitFileW() */
-    NULL, /* onInitMemory() */
+    ma_decoding_backend_init_memory__libvorbis,
     ma_decoding_backend_uninit__libvorbis
 };
 ma_decoding_backend_vtable* ma_decoding_backend_libvorbis = &ma_gDecodingBackendVTable_libvorbis;
@@ -0,0 +1,164 @@
+#ifndef miniaudio_mp3_seek_c
+#define miniaudio_mp3_seek_c
+
+#include "miniaudio_mp3_seek.h"
+
+/* Binding relies on our seek point being dr_mp3's seek point under another name. */
+typedef char ma_mp3_seek_point_layout_check[(sizeof(ma_mp3_seek_point) == sizeof(ma_dr_mp3_seek_point)) ? 1 : -1];
+
+MA_API ma_result ma_mp3_scan_seek_table(const void* pData, size_t dataSize, ma_mp3_seek_point** ppSeekPoints, ma_uint32* pSeekPointCount, ma_uint64* pTotalPCMFrameCount)
+{
+#if !defined(MA_NO_MP3)
+    ma_dr_mp3 mp3;
+    ma_dr_mp3__seeking_mp3_frame_info mp3FrameInfo[MA_DR_MP3_SEEK_LEADING_MP3_FRAMES+1];
+    ma_mp3_seek_point* pSeekPoints = NULL;
+    ma_uint32 seekPointCount = 0;
+    ma_uint32 seekPointCap = 0;
+    ma_uint64 totalMP3FrameCount = 0;
+    ma_uint64 totalPCMFrameCount = 0;
+    ma_uint64 runningPCMFrameCount = 0;
+    float runningPCMFrameCountFractionalPart = 0;
+    ma_uint64 pcmFramesBetweenSeekPoints;
+    ma_uint64 nextTargetPCMFrame;
+
+    if (pData == NULL || dataSize == 0 || ppSeekPoints == NULL || pSeekPointCount == NULL || pTotalPCMFrameCount == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    *ppSeekPoints = NULL;
+    *pSeekPointCount = 0;
+
+    if (!ma_dr_mp3_init_memory(&mp3, pData, dataSize, NULL)) {
+        return MA_INVALID_FILE;
+    }
+    MA_ZERO_OBJECT(&mp3FrameInfo);
+
+    /* Initialisation has already decoded the first frame. */
+    if (!ma_dr_mp3_seek_to_start_of_stream(&mp3)) {
+        ma_dr_mp3_uninit(&mp3);
+        return MA_INVALID_FILE;
+    }
+
+    /*
+    The same points ma_dr_mp3_calculate_seek_points() would place, one per second, but gathered in
+    the one pass that also counts the frames: that function scans once for the count and again for
+    the points. The last MA_DR_MP3_SEEK_LEADING_MP3_FRAMES+1 frame starts are kept so each point
+    can begin that many frames early, which dr_mp3 decodes and discards to prime the bit reservoir.
+    */
+    pcmFramesBetweenSeekPoints = mp3.sampleRate > 0 ? mp3.sampleRate : 44100;
+    nextTargetPCMFrame = pcmFramesBetweenSeekPoints;
+
+    for (;;) {
+        ma_uint32 pcmFramesInCurrentMP3Frame;
+        size_t iInfo;
+
+        for (iInfo = 0; iInfo < MA_DR_MP3_COUNTOF(mp3FrameInfo)-1; ++iInfo) {
+            mp3FrameInfo[iInfo] = mp3FrameInfo[iInfo+1];
+        }
+        mp3FrameInfo[MA_DR_MP3_COUNTOF(mp3FrameInfo)-1].bytePos       = mp3.streamCursor - mp3.dataSize;
+        mp3FrameInfo[MA_DR_MP3_COUNTOF(mp3FrameInfo)-1].pcmFrameIndex = runningPCMFrameCount;
+
+        pcmFramesInCurrentMP3Frame = ma_dr_mp3_decode_next_frame_ex(&mp3, NULL, NULL, NULL);
+        if (pcmFramesInCurrentMP3Frame == 0) {
+            break;
+        }
+        totalPCMFrameCount += pcmFramesInCurrentMP3Frame;
+        totalMP3FrameCount += 1;
+        ma_dr_mp3__accumulate_running_pcm_frame_count(&mp3, pcmFramesInCurrentMP3Frame, &runningPCMFrameCount, &runningPCMFrameCountFractionalPart);
+
+        /* Until the leading frames exist, a point could not start early enough. */
+        if (totalMP3FrameCount < MA_DR_MP3_SEEK_LEADING_MP3_FRAMES+1) {
+            continue;
+        }
+
+        while (nextTargetPCMFrame < runningPCMFrameCount && seekPointCount < MA_MP3_SEEK_MAX_POINTS) {
+            if (seekPointCount == seekPointCap) {
+                ma_uint32 newCap = seekPointCap == 0 ? 256 : seekPointCap * 2;
+                ma_mp3_seek_point* pNewSeekPoints = (ma_mp3_seek_point*)ma_realloc(pSeekPoints, newCap * sizeof(*pSeekPoints), NULL);
+                if (pNewSeekPoints == NULL) {
+                    ma_free(pSeekPoints, NULL);
+                    ma_dr_mp3_uninit(&mp3);
+                    return MA_OUT_OF_MEMORY;
+                }
+                pSeekPoints = pNewSeekPoints;
+                seekPointCap = newCap;
+            }
+
+            pSeekPoints[seekPointCount].seekPosInBytes     = mp3FrameInfo[0].bytePos;
+            pSeekPoints[seekPointCount].pcmFrameIndex      = nextTargetPCMFrame;
+            pSeekPoints[seekPointCount].mp3FramesToDiscard = MA_DR_MP3_SEEK_LEADING_MP3_FRAMES;
+            pSeekPoints[seekPointCount].pcmFramesToDiscard = (ma_uint16)(nextTargetPCMFrame - mp3FrameInfo[MA_DR_MP3_SEEK_LEADING_MP3_FRAMES-1].pcmFrameIndex);
+            seekPointCount += 1;
+            nextTargetPCMFrame += pcmFramesBetweenSeekPoints;
+        }
+    }
+
+    ma_dr_mp3_uninit(&mp3);
+
+    if (totalMP3FrameCount == 0) {
+        ma_free(pSeekPoints, NULL);
+        return MA_INVALID_FILE;
+    }
+
+    /* Shorter than a second, or than the leading frames: one point at the start, as dr_mp3 does. */
+    if (seekPointCount == 0) {
+        pSeekPoints = (ma_mp3_seek_point*)ma_malloc(sizeof(*pSeekPoints), NULL);
+        if (pSeekPoints == NULL) {
+            return MA_OUT_OF_MEMORY;
+        }
+        pSeekPoints[0].seekPosInBytes     = 0;
+        pSeekPoints[0].pcmFrameIndex      = 0;
+        pSeekPoints[0].mp3FramesToDiscard = 0;
+        pSeekPoints[0].pcmFramesToDiscard = 0;
+        seekPointCount = 1;
+    }
+
+    *ppSeekPoints = pSeekPoints;
+    *pSeekPointCount = seekPointCount;
+    *pTotalPCMFrameCount = totalPCMFrameCount;
+    return MA_SUCCESS;
+#else
+    (void)pData;
+    (void)dataSize;
+    (void)ppSeekPoints;
+    (void)pSeekPointCount;
+    (void)pTotalPCMFrameCount;
+    return MA_NOT_IMPLEMENTED;
+#endif
+}
+
+MA_API ma_bool32 ma_decoder_is_mp3(const ma_decoder* pDecoder)
+{
+#if !defined(MA_NO_MP3)
+    return pDecoder != NULL && pDecoder->pBackendVTable == &g_ma_decoding_backend_vtable_mp3;
+#else
+    (void)pDecoder;
+    return MA_FALSE;
+#endif
+}
+
+MA_API ma_result ma_decoder_bind_mp3_seek_table(ma_decoder* pDecoder, ma_uint32 seekPointCount, const ma_mp3_seek_point* pSeekPoints)
+{
+#if !defined(MA_NO_MP3)
+    ma_mp3* pMP3;
+
+    if (!ma_decoder_is_mp3(pDecoder)) {
+        return MA_INVALID_OPERATION;
+    }
+
+    /* dr_mp3 never writes through the table; the cast only satisfies its signature. */
+    pMP3 = (ma_mp3*)pDecoder->pBackend;
+    if (!ma_dr_mp3_bind_seek_table(&pMP3->dr, seekPointCount, (ma_dr_mp3_seek_point*)pSeekPoints)) {
+        return MA_ERROR;
+    }
+
+    return MA_SUCCESS;
+#else
+    (void)pDecoder;
+    (void)seekPointCount;
+    (void)pSeekPoints;
+    return MA_INVALID_OPERATION;
+#endif
+}
+
+#endif  /* miniaudio_mp3_seek_c */
@@ -0,0 +1,48 @@
+/*
+Seek tables for miniaudio's built-in MP3 decoder.
+
+dr_mp3 only lives in miniaudio's implementation section, so these helpers are compiled into the
+translation unit that defines MINIAUDIO_IMPLEMENTATION and expose just what a caller needs to build
+a table over an in-memory MP3, store it, and bind it to an `ma_decoder` later.
+*/
+#ifndef miniaudio_mp3_seek_h
+#define miniaudio_mp3_seek_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "miniaudio.h"
+
+/* Upper bound on seek points, a little over 18 hours at one per second. */
+#define MA_MP3_SEEK_MAX_POINTS  65535
+
+/* Layout-compatible with dr_mp3's seek point, so a stored table can be bound without a copy. */
+typedef struct
+{
+    ma_uint64 seekPosInBytes;
+    ma_uint64 pcmFrameIndex;
+    ma_uint16 mp3FramesToDiscard;
+    ma_uint16 pcmFramesToDiscard;
+} ma_mp3_seek_point;
+
+/*
+Scans an MP3 held in memory once, placing a seek point every second. On success *ppSeekPoints
+holds *pSeekPointCount points, allocated with ma_malloc() and released by the caller with
+ma_free(), and *pTotalPCMFrameCount the exact stream length.
+*/
+MA_API ma_result ma_mp3_scan_seek_table(const void* pData, size_t dataSize, ma_mp3_seek_point** ppSeekPoints, ma_uint32* pSeekPointCount, ma_uint64* pTotalPCMFrameCount);
+
+/* Whether the decoder is running miniaudio's stock MP3 backend. */
+MA_API ma_bool32 ma_decoder_is_mp3(const ma_decoder* pDecoder);
+
+/*
+Makes the decoder's MP3 backend seek through the given table. The table is not copied and must
+outlive the decoder or a later bind. Returns MA_INVALID_OPERATION for any other backend.
+*/
+MA_API ma_result ma_decoder_bind_mp3_seek_table(ma_decoder* pDecoder, ma_uint32 seekPointCount, const ma_mp3_seek_point* pSeekPoints);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* miniaudio_mp3_seek_h */
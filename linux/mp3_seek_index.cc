@@ -0,0 +1,160 @@
+#include "mp3_seek_index.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace just_audio_windows_linux {
+
+// Bytes from each end of the file that go into the sidecar key.
+static constexpr size_t kKeyBytes = 64 * 1024;
+
+static const char kSidecarMagic[8] = {'J', 'A', 'M', 'P', '3', 'S', 'K', '1'};
+
+struct SidecarHeader {
+  char magic[8];
+  ma_uint32 point_size;
+  ma_uint32 point_count;
+  ma_uint64 file_size;
+  ma_uint64 total_frames;
+};
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+/* ---------------- sidecar location ---------------- */
+
+std::string Mp3SeekIndex::SidecarPath(const MappedFile &file,
+                                      bool create_dir) {
+  std::string dir;
+  const char *cache_home = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  if (cache_home != nullptr && cache_home[0] == '/') {
+    dir = cache_home;
+  } else if (home != nullptr && home[0] != '\0') {
+    dir = std::string(home) + "/.cache";
+  } else {
+    return std::string();
+  }
+
+  // Each level may be missing on a fresh account.
+  for (const char *level : {"", "/just_audio_windows_linux", "/mp3_seek"}) {
+    dir += level;
+    if (create_dir) {
+      mkdir(dir.c_str(), 0755);
+    }
+  }
+
+  // Content rather than path: a moved file keeps its index, an edited one
+  // gets a fresh one. Head and tail cover tags and the audio either side.
+  const char *data = static_cast<const char *>(file.data());
+  size_t size = file.size();
+  size_t head = size < kKeyBytes ? size : kKeyBytes;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  hash = fnv1a(hash, &size, sizeof(size));
+  hash = fnv1a(hash, data, head);
+  hash = fnv1a(hash, data + size - head, head);
+
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx.idx", (unsigned long long)hash);
+  return dir + name;
+}
+
+/* ---------------- load / save ---------------- */
+
+std::shared_ptr<const Mp3SeekIndex>
+Mp3SeekIndex::Load(const MappedFile &file) {
+  std::string path = SidecarPath(file, false);
+  if (path.empty()) {
+    return nullptr;
+  }
+
+  FILE *in = fopen(path.c_str(), "rb");
+  if (in == nullptr) {
+    return nullptr;
+  }
+
+  // The count is checked against the cap and the sidecar's actual size
+  // before anything is allocated for it; the file may be corrupt.
+  std::shared_ptr<Mp3SeekIndex> index(new Mp3SeekIndex());
+  SidecarHeader header;
+  struct stat st;
+  bool ok = fread(&header, sizeof(header), 1, in) == 1 &&
+            memcmp(header.magic, kSidecarMagic, sizeof(kSidecarMagic)) == 0 &&
+            header.point_size == sizeof(ma_mp3_seek_point) &&
+            header.file_size == file.size() && header.point_count > 0 &&
+            header.point_count <= MA_MP3_SEEK_MAX_POINTS &&
+            fstat(fileno(in), &st) == 0 &&
+            (ma_uint64)st.st_size ==
+                sizeof(header) +
+                    (ma_uint64)header.point_count * sizeof(ma_mp3_seek_point);
+  if (ok) {
+    index->points_.resize(header.point_count);
+    index->total_frames_ = header.total_frames;
+    ok = fread(index->points_.data(), sizeof(ma_mp3_seek_point),
+               header.point_count, in) == header.point_count;
+  }
+  fclose(in);
+
+  return ok ? index : nullptr;
+}
+
+bool Mp3SeekIndex::Save(const MappedFile &file) const {
+  std::string path = SidecarPath(file, true);
+  if (path.empty()) {
+    return false;
+  }
+
+  // Written aside and renamed into place so a reader never sees half a file.
+  std::string temp = path + "." + std::to_string(getpid()) + ".tmp";
+  FILE *out = fopen(temp.c_str(), "wb");
+  if (out == nullptr) {
+    return false;
+  }
+
+  SidecarHeader header;
+  memcpy(header.magic, kSidecarMagic, sizeof(kSidecarMagic));
+  header.point_size = sizeof(ma_mp3_seek_point);
+  header.point_count = (ma_uint32)points_.size();
+  header.file_size = file.size();
+  header.total_frames = total_frames_;
+
+  bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+            fwrite(points_.data(), sizeof(ma_mp3_seek_point), points_.size(),
+                   out) == points_.size();
+  ok = fclose(out) == 0 && ok;
+
+  if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+    unlink(temp.c_str());
+    return false;
+  }
+  return true;
+}
+
+/* ---------------- build ---------------- */
+
+std::shared_ptr<const Mp3SeekIndex>
+Mp3SeekIndex::Build(const MappedFile &file) {
+  std::shared_ptr<Mp3SeekIndex> index(new Mp3SeekIndex());
+
+  ma_mp3_seek_point *points = nullptr;
+  ma_uint32 count = 0;
+  if (ma_mp3_scan_seek_table(file.data(), file.size(), &points, &count,
+                             &index->total_frames_) != MA_SUCCESS) {
+    return nullptr;
+  }
+  index->points_.assign(points, points + count);
+  ma_free(points, nullptr);
+  return index;
+}
+
+} // namespace just_audio_windows_linux
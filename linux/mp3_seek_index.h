@@ -0,0 +1,43 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+#include "miniaudio.h"
+#include "miniaudio_mp3_seek.h"
+
+namespace just_audio_windows_linux {
+
+/* ---------------- Mp3SeekIndex ---------------- */
+
+// Seek points for one MP3, plus its exact length. Building one scans every
+// frame header, so the result is persisted as a sidecar under the user cache
+// directory, named after a hash of the file's size, head and tail; later
+// sessions load it in place of the scan. Immutable once made.
+class Mp3SeekIndex {
+public:
+  // The sidecar written for this file's content, or nullptr.
+  static std::shared_ptr<const Mp3SeekIndex> Load(const MappedFile &file);
+
+  // Scans the stream. Slow for long files; never on the main or audio thread.
+  static std::shared_ptr<const Mp3SeekIndex> Build(const MappedFile &file);
+
+  // Writes the sidecar for file. Best effort: a read-only cache directory
+  // just means the next session builds again.
+  bool Save(const MappedFile &file) const;
+
+  const std::vector<ma_mp3_seek_point> &points() const { return points_; }
+  ma_uint64 total_frames() const { return total_frames_; }
+
+private:
+  Mp3SeekIndex() = default;
+
+  static std::string SidecarPath(const MappedFile &file, bool create_dir);
+
+  std::vector<ma_mp3_seek_point> points_;
+  ma_uint64 total_frames_ = 0;
+};
+
+} // namespace just_audio_windows_linux
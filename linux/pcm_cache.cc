@@ -0,0 +1,108 @@
+#include "pcm_cache.h"
+
+namespace just_audio_windows_linux {
+
+/* ---------------- singleton ---------------- */
+
+PcmCache &PcmCache::Instance() {
+  static PcmCache cache;
+  return cache;
+}
+
+void PcmCache::Configure(size_t budget_bytes, ma_uint32 max_clip_ms) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  budget_bytes_ = budget_bytes;
+  max_clip_ms_ = max_clip_ms;
+  EvictLocked(max_clip_ms_ == 0 ? 0 : budget_bytes_);
+}
+
+size_t PcmCache::budget_bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return budget_bytes_;
+}
+
+ma_uint32 PcmCache::max_clip_ms() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return max_clip_ms_;
+}
+
+/* ---------------- lookup ---------------- */
+
+// The channel count leads, so the first ':' always ends it.
+std::string PcmCache::Key(const std::string &path, ma_uint32 channels) {
+  return std::to_string(channels) + ":" + path;
+}
+
+ma_uint64 PcmCache::MaxClipFrames(ma_uint32 sample_rate,
+                                  ma_uint32 channels) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (sample_rate == 0 || channels == 0) {
+    return 0;
+  }
+  ma_uint64 by_length = (ma_uint64)max_clip_ms_ * sample_rate / 1000;
+  ma_uint64 by_budget = budget_bytes_ / (channels * sizeof(float));
+  return by_length < by_budget ? by_length : by_budget;
+}
+
+bool PcmCache::Accepts(ma_uint64 frames, ma_uint32 sample_rate,
+                       ma_uint32 channels) const {
+  return frames != 0 && frames <= MaxClipFrames(sample_rate, channels);
+}
+
+std::shared_ptr<const PcmClip> PcmCache::Find(const std::string &path,
+                                              int64_t mtime,
+                                              ma_uint32 channels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(Key(path, channels));
+  if (it == entries_.end()) {
+    return nullptr;
+  }
+
+  // Only a stale entry goes; another layout of the file has its own key.
+  Entry &entry = it->second;
+  if (entry.mtime != mtime) {
+    used_bytes_ -= entry.clip->bytes();
+    lru_.erase(entry.lru);
+    entries_.erase(it);
+    return nullptr;
+  }
+
+  lru_.splice(lru_.begin(), lru_, entry.lru);
+  return entry.clip;
+}
+
+/* ---------------- insertion ---------------- */
+
+void PcmCache::Insert(const std::string &path, int64_t mtime,
+                      ma_uint32 channels,
+                      std::shared_ptr<const PcmClip> clip) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (clip->bytes() > budget_bytes_ || max_clip_ms_ == 0) {
+    return;
+  }
+
+  std::string key = Key(path, channels);
+  auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    used_bytes_ -= it->second.clip->bytes();
+    lru_.erase(it->second.lru);
+    entries_.erase(it);
+  }
+
+  EvictLocked(budget_bytes_ - clip->bytes());
+
+  lru_.push_front(key);
+  used_bytes_ += clip->bytes();
+  entries_[key] = Entry{std::move(clip), mtime, lru_.begin()};
+}
+
+void PcmCache::EvictLocked(size_t budget_bytes) {
+  while (used_bytes_ > budget_bytes && !lru_.empty()) {
+    auto it = entries_.find(lru_.back());
+    used_bytes_ -= it->second.clip->bytes();
+    entries_.erase(it);
+    lru_.pop_back();
+  }
+}
+
+} // namespace just_audio_windows_linux
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "miniaudio.h"
+
+namespace just_audio_windows_linux {
+
+/* ---------------- PcmClip ---------------- */
+
+// A fully decoded file: interleaved f32 at the file's own rate.
+// source_channels is the file's own channel count, which channels may have
+// been mixed from.
+struct PcmClip {
+  std::vector<float> samples;
+  ma_uint64 frames = 0;
+  ma_uint32 channels = 0;
+  ma_uint32 source_channels = 0;
+  ma_uint32 sample_rate = 0;
+
+  size_t bytes() const { return samples.size() * sizeof(float); }
+};
+
+/* ---------------- PcmCache ---------------- */
+
+// Process-wide LRU of decoded short clips, keyed by path and requested
+// channel count, so players decoding the same file to different layouts
+// each keep their own. The modification time is checked on lookup so an
+// edited file is decoded afresh. Clips are shared: a track playing one keeps
+// it alive after eviction. Safe from any thread.
+class PcmCache {
+public:
+  static PcmCache &Instance();
+
+  // A zero budget or clip length disables caching and drops what is held.
+  void Configure(size_t budget_bytes, ma_uint32 max_clip_ms);
+  size_t budget_bytes() const;
+  ma_uint32 max_clip_ms() const;
+
+  // The longest clip that would be kept, in frames; 0 when caching is off.
+  ma_uint64 MaxClipFrames(ma_uint32 sample_rate, ma_uint32 channels) const;
+
+  // Whether a clip of this length would be kept.
+  bool Accepts(ma_uint64 frames, ma_uint32 sample_rate,
+               ma_uint32 channels) const;
+
+  // Returns the clip cached for path decoded to `channels`, if its mtime
+  // still matches. Zero channels asks for the file's own layout.
+  std::shared_ptr<const PcmClip> Find(const std::string &path, int64_t mtime,
+                                      ma_uint32 channels);
+
+  // Stores clip, decoded to `channels` as passed to Find(), as most recently
+  // used, evicting from the cold end until the budget holds.
+  void Insert(const std::string &path, int64_t mtime, ma_uint32 channels,
+              std::shared_ptr<const PcmClip> clip);
+
+private:
+  PcmCache() = default;
+
+  struct Entry {
+    std::shared_ptr<const PcmClip> clip;
+    int64_t mtime = 0;
+    std::list<std::string>::iterator lru;
+  };
+
+  static std::string Key(const std::string &path, ma_uint32 channels);
+  void EvictLocked(size_t budget_bytes);
+
+  mutable std::mutex mutex_;
+  size_t budget_bytes_ = 32 * 1024 * 1024;
+  ma_uint32 max_clip_ms_ = 5000;
+  size_t used_bytes_ = 0;
+
+  // Keys; front is most recently used.
+  std::list<std::string> lru_;
+  std::unordered_map<std::string, Entry> entries_;
+};
+
+} // namespace just_audio_windows_linux
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace just_audio_windows_linux {
+
+/* ---------------- PcmBlock ---------------- */
+
+// One slot of the ring: up to `block_frames` interleaved f32 frames plus the
+// playlist item and span of source frames they were decoded from. The two
+// frame counts differ when the decode thread resamples. generation is the
+// seek the block was decoded after, so the reader can drop stale audio.
+struct PcmBlock {
+  float *samples = nullptr;
+  uint32_t frames = 0;
+  uint32_t index = 0;
+  uint64_t source_frame = 0;
+  uint32_t source_frames = 0;
+  uint64_t generation = 0;
+};
+
+/* ---------------- PcmRingBuffer ---------------- */
+
+// Single-producer / single-consumer ring of fixed-size PCM blocks. The decode
+// thread is the only writer and the audio callback the only reader; neither
+// side takes a lock or allocates once init() has run.
+class PcmRingBuffer {
+public:
+  // Not thread safe: only call while neither side is touching the ring.
+  void init(uint32_t channels, uint32_t block_frames, uint32_t block_count) {
+    channels_ = channels;
+    block_frames_ = block_frames;
+    block_count_ = std::max<uint32_t>(block_count, 2);
+
+    storage_.assign(static_cast<size_t>(block_frames_) * channels_ *
+                        block_count_,
+                    0.0f);
+    blocks_.assign(block_count_, PcmBlock{});
+    for (uint32_t i = 0; i < block_count_; ++i) {
+      blocks_[i].samples =
+          storage_.data() + static_cast<size_t>(i) * block_frames_ * channels_;
+    }
+    reset();
+  }
+
+  // Not thread safe: only call while neither side is touching the ring.
+  void reset() {
+    write_index_.store(0, std::memory_order_relaxed);
+    read_index_.store(0, std::memory_order_relaxed);
+  }
+
+  /* -------- producer -------- */
+
+  // Returns the next free block, or nullptr when the ring is full.
+  PcmBlock *write_block() {
+    uint64_t write = write_index_.load(std::memory_order_relaxed);
+    uint64_t read = read_index_.load(std::memory_order_acquire);
+    if (write - read >= block_count_) {
+      return nullptr;
+    }
+    return &blocks_[write % block_count_];
+  }
+
+  void commit_write() {
+    write_index_.fetch_add(1, std::memory_order_release);
+  }
+
+  /* -------- consumer -------- */
+
+  // Returns the oldest filled block, or nullptr when the ring is empty.
+  PcmBlock *read_block() {
+    uint64_t read = read_index_.load(std::memory_order_relaxed);
+    uint64_t write = write_index_.load(std::memory_order_acquire);
+    if (read == write) {
+      return nullptr;
+    }
+    return &blocks_[read % block_count_];
+  }
+
+  void commit_read() { read_index_.fetch_add(1, std::memory_order_release); }
+
+  /* -------- query -------- */
+
+  uint32_t readable() const {
+    return static_cast<uint32_t>(write_index_.load(std::memory_order_acquire) -
+                                 read_index_.load(std::memory_order_acquire));
+  }
+
+  uint32_t channels() const { return channels_; }
+  uint32_t block_frames() const { return block_frames_; }
+  uint32_t block_count() const { return block_count_; }
+
+private:
+  std::vector<float> storage_;
+  std::vector<PcmBlock> blocks_;
+  uint32_t channels_ = 0;
+  uint32_t block_frames_ = 0;
+  uint32_t block_count_ = 0;
+
+  alignas(64) std::atomic<uint64_t> write_index_{0};
+  alignas(64) std::atomic<uint64_t> read_index_{0};
+};
+
+} // namespace just_audio_windows_linux
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace just_audio_windows_linux {
+
+/* ---------------- RtEvent ---------------- */
+
+// What the audio callback has to tell the main thread. Plain data, copied
+// by value through the queue.
+enum class RtEventKind : uint32_t {
+  // Playback crossed into playlist item `index`.
+  kIndexChanged,
+  // The last item played out.
+  kCompleted,
+};
+
+struct RtEvent {
+  RtEventKind kind = RtEventKind::kIndexChanged;
+  uint32_t index = 0;
+  // Source frame of `index` playing when the event was raised.
+  uint64_t frame = 0;
+};
+
+/* ---------------- RtEventQueue ---------------- */
+
+// Single-producer / single-consumer queue from the audio callback to the
+// main loop. push() neither locks nor allocates and never calls into GLib;
+// it bumps an eventfd the consumer watches with a GSource, so the main loop
+// sleeps until there is something to drain. When the consumer falls behind
+// the queue drops the newest events and remembers that it did.
+class RtEventQueue {
+public:
+  static constexpr uint32_t kCapacity = 64;
+
+  RtEventQueue() : fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {}
+  ~RtEventQueue() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  RtEventQueue(const RtEventQueue &) = delete;
+  RtEventQueue &operator=(const RtEventQueue &) = delete;
+
+  // Readable whenever events are waiting; -1 if eventfd was unavailable, in
+  // which case the consumer has to poll.
+  int fd() const { return fd_; }
+
+  /* -------- producer -------- */
+
+  bool push(const RtEvent &event) {
+    uint64_t write = write_index_.load(std::memory_order_relaxed);
+    uint64_t read = read_index_.load(std::memory_order_acquire);
+    if (write - read >= kCapacity) {
+      overflowed_.store(true, std::memory_order_relaxed);
+      return false;
+    }
+    events_[write % kCapacity] = event;
+    write_index_.store(write + 1, std::memory_order_release);
+
+    // A full counter (EAGAIN) already means "readable"; nothing to retry.
+    if (fd_ >= 0) {
+      uint64_t one = 1;
+      ssize_t result;
+      do {
+        result = ::write(fd_, &one, sizeof(one));
+      } while (result < 0 && errno == EINTR);
+    }
+    return true;
+  }
+
+  /* -------- consumer -------- */
+
+  // Resets the eventfd. Call before draining, so that an event pushed after
+  // the last pop() signals again.
+  void acknowledge() {
+    if (fd_ >= 0) {
+      uint64_t count;
+      ssize_t ignored = ::read(fd_, &count, sizeof(count));
+      (void)ignored;
+    }
+  }
+
+  // Pops the oldest event into *event; false once the queue is empty.
+  bool pop(RtEvent *event) {
+    uint64_t read = read_index_.load(std::memory_order_relaxed);
+    uint64_t write = write_index_.load(std::memory_order_acquire);
+    if (read == write) {
+      return false;
+    }
+    *event = events_[read % kCapacity];
+    read_index_.store(read + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Whether events were dropped since the last call.
+  bool take_overflow() {
+    return overflowed_.exchange(false, std::memory_order_relaxed);
+  }
+
+private:
+  int fd_;
+  RtEvent events_[kCapacity];
+  std::atomic<bool> overflowed_{false};
+
+  alignas(64) std::atomic<uint64_t> write_index_{0};
+  alignas(64) std::atomic<uint64_t> read_index_{0};
+};
+
+} // namespace just_audio_windows_linux
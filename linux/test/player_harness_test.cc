@@ -0,0 +1,566 @@
+// Drives AudioPlayer end to end without Flutter or a sound card: the device
+// runs on miniaudio's null backend and the channels talk to a mock binary
+// messenger that records every message with the time it arrived. The tests
+// script load/play/seek/dispose sequences and fail when the player stops
+// behaving: events go missing, position stalls, dispose leaves a load
+// unanswered. Latency and jitter are always reported, and only checked
+// against the limits below when $JUST_AUDIO_HARNESS_LIMITS is set.
+
+#include <flutter_linux/flutter_linux.h>
+#include <glib/gstdio.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio_engine.h"
+#include "audio_player.h"
+
+using namespace just_audio_windows_linux;
+
+namespace {
+
+/* ---------------- limits ---------------- */
+
+// What an idle desktop manages comfortably. Shared CI runners miss them
+// for reasons that have nothing to do with the player, so they are opt-in:
+// JUST_AUDIO_HARNESS_LIMITS=1 checks them as they are, and any other
+// positive number scales them, e.g. 4 on a slow runner.
+constexpr double kMaxLoadToFirstSampleMs = 250;
+constexpr double kMaxPlayToFirstSampleMs = 100;
+constexpr double kMaxSeekToFirstSampleMs = 100;
+constexpr double kMaxEventDeliveryMs = 20;
+constexpr double kMaxDisposeMs = 200;
+// Deviation of callback intervals from the period they cover.
+constexpr double kMaxJitterP99Ms = 5;
+constexpr double kMaxJitterMs = 30;
+
+// 0 when the limits are off.
+double LimitScale() {
+  const char *value = getenv("JUST_AUDIO_HARNESS_LIMITS");
+  if (value == nullptr || *value == '\0') {
+    return 0;
+  }
+  double scale = std::atof(value);
+  return scale > 0 ? scale : 0;
+}
+
+constexpr auto kTimeout = std::chrono::seconds(5);
+
+using Clock = std::chrono::steady_clock;
+
+double Ms(Clock::duration elapsed) {
+  return std::chrono::duration<double, std::milli>(elapsed).count();
+}
+
+/* ---------------- fixtures ---------------- */
+
+// A stereo tone at 44.1 kHz, so playback also goes through the resampler.
+std::string WriteTone(const std::string &dir, const char *name,
+                      double seconds) {
+  std::string path = dir + "/" + name;
+  const ma_uint32 rate = 44100;
+  ma_encoder_config config =
+      ma_encoder_config_init(ma_encoding_format_wav, ma_format_f32, 2, rate);
+  ma_encoder encoder;
+  if (ma_encoder_init_file(path.c_str(), &config, &encoder) != MA_SUCCESS) {
+    return "";
+  }
+  ma_uint64 frames = (ma_uint64)(seconds * rate);
+  std::vector<float> samples(frames * 2);
+  for (ma_uint64 i = 0; i < frames; ++i) {
+    samples[i * 2] = samples[i * 2 + 1] =
+        0.25f * std::sin(2 * M_PI * 440 * (double)i / rate);
+  }
+  ma_encoder_write_pcm_frames(&encoder, samples.data(), frames, nullptr);
+  ma_encoder_uninit(&encoder);
+  return path;
+}
+
+/* ---------------- callback probe ---------------- */
+
+// Attached next to the player, records when each engine callback runs and
+// how much it covered. Leaves the output alone.
+class CallbackProbe : public AudioRenderer {
+public:
+  static constexpr size_t kCapacity = 4096;
+
+  void Render(float *, ma_uint32 frameCount) override {
+    size_t n = count_.load(std::memory_order_relaxed);
+    if (n < kCapacity) {
+      times_[n] = Clock::now();
+      frames_[n] = frameCount;
+      count_.store(n + 1, std::memory_order_release);
+    }
+  }
+
+  size_t count() const { return count_.load(std::memory_order_acquire); }
+  Clock::time_point time(size_t i) const { return times_[i]; }
+  ma_uint32 frames(size_t i) const { return frames_[i]; }
+
+private:
+  Clock::time_point times_[kCapacity];
+  ma_uint32 frames_[kCapacity];
+  std::atomic<size_t> count_{0};
+};
+
+/* ---------------- mock messenger ---------------- */
+
+struct Message {
+  std::string channel;
+  Clock::time_point received;
+  FlValue *value;
+};
+
+struct Handler {
+  FlBinaryMessengerMessageHandler handler;
+  gpointer user_data;
+  GDestroyNotify destroy_notify;
+
+  void Release() {
+    if (destroy_notify != nullptr) {
+      destroy_notify(user_data);
+    }
+  }
+};
+
+struct Recorder {
+  std::map<std::string, Handler> handlers;
+  std::vector<Message> events;
+  std::map<int, FlValue *> responses;
+  std::map<int, bool> errors;
+  std::map<int, std::string> error_codes;
+
+  ~Recorder() {
+    for (auto &handler : handlers) {
+      handler.second.Release();
+    }
+    for (Message &message : events) {
+      fl_value_unref(message.value);
+    }
+    for (auto &response : responses) {
+      if (response.second != nullptr) {
+        fl_value_unref(response.second);
+      }
+    }
+  }
+};
+
+FlMethodCodec *Codec() {
+  static FlStandardMethodCodec *codec = fl_standard_method_codec_new();
+  return FL_METHOD_CODEC(codec);
+}
+
+} // namespace
+
+G_DECLARE_FINAL_TYPE(MockResponseHandle, mock_response_handle, MOCK,
+                     RESPONSE_HANDLE, FlBinaryMessengerResponseHandle)
+
+struct _MockResponseHandle {
+  FlBinaryMessengerResponseHandle parent_instance;
+  int call_id;
+};
+
+G_DEFINE_TYPE(MockResponseHandle, mock_response_handle,
+              fl_binary_messenger_response_handle_get_type())
+
+static void mock_response_handle_class_init(MockResponseHandleClass *) {}
+static void mock_response_handle_init(MockResponseHandle *) {}
+
+G_DECLARE_FINAL_TYPE(MockMessenger, mock_messenger, MOCK, MESSENGER, GObject)
+
+struct _MockMessenger {
+  GObject parent_instance;
+  Recorder *recorder;
+};
+
+static void mock_messenger_iface_init(FlBinaryMessengerInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(MockMessenger, mock_messenger, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(fl_binary_messenger_get_type(),
+                                              mock_messenger_iface_init))
+
+static void mock_messenger_class_init(MockMessengerClass *) {}
+static void mock_messenger_init(MockMessenger *) {}
+
+static void mock_set_message_handler_on_channel(
+    FlBinaryMessenger *messenger, const gchar *channel,
+    FlBinaryMessengerMessageHandler handler, gpointer user_data,
+    GDestroyNotify destroy_notify) {
+  // Like the engine's messenger, a replaced handler's data is released.
+  Recorder *recorder = MOCK_MESSENGER(messenger)->recorder;
+  auto existing = recorder->handlers.find(channel);
+  if (existing != recorder->handlers.end()) {
+    Handler old = existing->second;
+    recorder->handlers.erase(existing);
+    old.Release();
+  }
+  if (handler != nullptr) {
+    recorder->handlers[channel] = {handler, user_data, destroy_notify};
+  }
+}
+
+// Method call responses come back here.
+static gboolean mock_send_response(FlBinaryMessenger *messenger,
+                                   FlBinaryMessengerResponseHandle *handle,
+                                   GBytes *response, GError **error) {
+  Recorder *recorder = MOCK_MESSENGER(messenger)->recorder;
+  int call_id = MOCK_RESPONSE_HANDLE(handle)->call_id;
+  g_autoptr(FlMethodResponse) decoded =
+      FL_METHOD_CODEC_GET_CLASS(Codec())->decode_response(Codec(), response,
+                                                          error);
+  FlValue *result = nullptr;
+  if (decoded != nullptr && FL_IS_METHOD_SUCCESS_RESPONSE(decoded)) {
+    result = fl_method_success_response_get_result(
+        FL_METHOD_SUCCESS_RESPONSE(decoded));
+  }
+  recorder->responses[call_id] =
+      result != nullptr ? fl_value_ref(result) : fl_value_new_null();
+  recorder->errors[call_id] =
+      decoded == nullptr || !FL_IS_METHOD_SUCCESS_RESPONSE(decoded);
+  if (decoded != nullptr && FL_IS_METHOD_ERROR_RESPONSE(decoded)) {
+    recorder->error_codes[call_id] =
+        fl_method_error_response_get_code(FL_METHOD_ERROR_RESPONSE(decoded));
+  }
+  return TRUE;
+}
+
+// Event channel messages arrive here, encoded as success envelopes.
+static void mock_send_on_channel(FlBinaryMessenger *messenger,
+                                 const gchar *channel, GBytes *message,
+                                 GCancellable *cancellable,
+                                 GAsyncReadyCallback callback,
+                                 gpointer user_data) {
+  Clock::time_point received = Clock::now();
+  Recorder *recorder = MOCK_MESSENGER(messenger)->recorder;
+  g_autoptr(GError) error = nullptr;
+  g_autoptr(FlMethodResponse) decoded =
+      FL_METHOD_CODEC_GET_CLASS(Codec())->decode_response(Codec(), message,
+                                                          &error);
+  if (decoded != nullptr && FL_IS_METHOD_SUCCESS_RESPONSE(decoded)) {
+    FlValue *value = fl_method_success_response_get_result(
+        FL_METHOD_SUCCESS_RESPONSE(decoded));
+    recorder->events.push_back({channel, received, fl_value_ref(value)});
+  }
+
+  if (callback != nullptr) {
+    g_autoptr(GTask) task = g_task_new(messenger, cancellable, callback,
+                                       user_data);
+    g_task_return_pointer(task, nullptr, nullptr);
+  }
+}
+
+static GBytes *mock_send_on_channel_finish(FlBinaryMessenger *,
+                                           GAsyncResult *result,
+                                           GError **error) {
+  return static_cast<GBytes *>(
+      g_task_propagate_pointer(G_TASK(result), error));
+}
+
+// Only the four members every version of the interface has. Later Flutter
+// releases add more (resize_channel, set_warns_on_channel_overflow,
+// shutdown), which the channels the player uses never call; leaving them
+// unset keeps the mock compiling against older and newer engines alike.
+static void mock_messenger_iface_init(FlBinaryMessengerInterface *iface) {
+  iface->set_message_handler_on_channel = mock_set_message_handler_on_channel;
+  iface->send_response = mock_send_response;
+  iface->send_on_channel = mock_send_on_channel;
+  iface->send_on_channel_finish = mock_send_on_channel_finish;
+}
+
+namespace {
+
+/* ---------------- harness ---------------- */
+
+class PlayerHarness : public ::testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    AudioEngine::Instance().SetBackends({ma_backend_null});
+
+    g_autoptr(GError) error = nullptr;
+    gchar *dir = g_dir_make_tmp("just_audio_harness_XXXXXX", &error);
+    ASSERT_NE(dir, nullptr);
+    fixture_dir_ = dir;
+    g_free(dir);
+    long_tone_ = WriteTone(fixture_dir_, "long.wav", 4.0);
+    short_tone_ = WriteTone(fixture_dir_, "short.wav", 0.6);
+    ASSERT_FALSE(long_tone_.empty());
+    ASSERT_FALSE(short_tone_.empty());
+  }
+
+  static void TearDownTestSuite() {
+    g_remove(long_tone_.c_str());
+    g_remove(short_tone_.c_str());
+    g_rmdir(fixture_dir_.c_str());
+  }
+
+  void SetUp() override {
+    messenger_ = MOCK_MESSENGER(g_object_new(mock_messenger_get_type(),
+                                             nullptr));
+    messenger_->recorder = &recorder_;
+    player_ = std::make_unique<AudioPlayer>(
+        "harness", FL_BINARY_MESSENGER(messenger_));
+  }
+
+  void TearDown() override {
+    player_.reset();
+    // Anything still queued for the player has to drain before the next
+    // test reuses the channel names.
+    Pump(std::chrono::milliseconds(20));
+    g_object_unref(messenger_);
+  }
+
+  // Sends a method call the way the Dart side would and returns its id.
+  int Call(const char *method, FlValue *args) {
+    g_autoptr(FlValue) owned_args = args;
+    g_autoptr(GError) error = nullptr;
+    g_autoptr(GBytes) message =
+        FL_METHOD_CODEC_GET_CLASS(Codec())->encode_method_call(
+            Codec(), method, args, &error);
+    EXPECT_NE(message, nullptr);
+
+    auto handler =
+        recorder_.handlers.find("com.ryanheise.just_audio.methods.harness");
+    EXPECT_NE(handler, recorder_.handlers.end());
+    if (message == nullptr || handler == recorder_.handlers.end()) {
+      return -1;
+    }
+
+    int call_id = next_call_id_++;
+    MockResponseHandle *handle = MOCK_RESPONSE_HANDLE(
+        g_object_new(mock_response_handle_get_type(), nullptr));
+    handle->call_id = call_id;
+    handler->second.handler(FL_BINARY_MESSENGER(messenger_),
+                            handler->first.c_str(), message,
+                            FL_BINARY_MESSENGER_RESPONSE_HANDLE(handle),
+                            handler->second.user_data);
+    g_object_unref(handle);
+    return call_id;
+  }
+
+  FlValue *LoadArgs(const std::vector<std::string> &paths) {
+    FlValue *children = fl_value_new_list();
+    for (const std::string &path : paths) {
+      FlValue *child = fl_value_new_map();
+      fl_value_set_string_take(child, "uri",
+                               fl_value_new_string(("file://" + path).c_str()));
+      fl_value_append_take(children, child);
+    }
+    FlValue *source = fl_value_new_map();
+    fl_value_set_string_take(source, "children", children);
+    FlValue *args = fl_value_new_map();
+    fl_value_set_string_take(args, "audioSource", source);
+    return args;
+  }
+
+  // Runs the main loop until done() holds; false on timeout. done() is
+  // checked between iterations, so it sees state as soon as it changes.
+  bool PumpUntil(const std::function<bool()> &done) {
+    Clock::time_point deadline = Clock::now() + kTimeout;
+    while (!done()) {
+      if (Clock::now() > deadline) {
+        return false;
+      }
+      if (!g_main_context_iteration(nullptr, FALSE)) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+    }
+    return true;
+  }
+
+  void Pump(Clock::duration duration) {
+    Clock::time_point end = Clock::now() + duration;
+    PumpUntil([&]() { return Clock::now() >= end; });
+  }
+
+  bool Responded(int call_id) const {
+    return recorder_.responses.count(call_id) != 0;
+  }
+
+  // When the first event after `since` matching `match` arrived.
+  bool EventTime(Clock::time_point since,
+                 const std::function<bool(FlValue *)> &match,
+                 Clock::time_point *received) const {
+    for (const Message &message : recorder_.events) {
+      if (message.received >= since &&
+          message.channel == "com.ryanheise.just_audio.events.harness" &&
+          match(message.value)) {
+        *received = message.received;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static int64_t IntField(FlValue *event, const char *key) {
+    FlValue *value = fl_value_lookup_string(event, key);
+    return value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_INT
+               ? fl_value_get_int(value)
+               : -1;
+  }
+
+  // Always reports the measurement; fails only when limits are on.
+  void CheckLimit(const char *metric, double ms, double limit) {
+    double scale = LimitScale();
+    if (scale > 0) {
+      std::printf("  %-28s %8.2f ms (limit %.0f)\n", metric, ms,
+                  limit * scale);
+      EXPECT_LT(ms, limit * scale) << metric;
+    } else {
+      std::printf("  %-28s %8.2f ms\n", metric, ms);
+    }
+    RecordProperty(metric, std::to_string(ms));
+  }
+
+  static std::string fixture_dir_;
+  static std::string long_tone_;
+  static std::string short_tone_;
+
+  Recorder recorder_;
+  MockMessenger *messenger_ = nullptr;
+  std::unique_ptr<AudioPlayer> player_;
+  int next_call_id_ = 1;
+};
+
+std::string PlayerHarness::fixture_dir_;
+std::string PlayerHarness::long_tone_;
+std::string PlayerHarness::short_tone_;
+
+/* ---------------- tests ---------------- */
+
+TEST_F(PlayerHarness, LoadAndPlayReachFirstSample) {
+  Clock::time_point start = Clock::now();
+  int load = Call("load", LoadArgs({long_tone_}));
+  Call("play", fl_value_new_map());
+  ASSERT_TRUE(PumpUntil([&]() { return player_->position() > 0; }));
+  double load_to_sample = Ms(Clock::now() - start);
+  ASSERT_TRUE(PumpUntil([&]() { return Responded(load); }));
+  EXPECT_FALSE(recorder_.errors[load]);
+
+  Call("pause", fl_value_new_map());
+  int64_t paused_at = player_->position();
+  start = Clock::now();
+  Call("play", fl_value_new_map());
+  ASSERT_TRUE(
+      PumpUntil([&]() { return player_->position() > paused_at; }));
+  double play_to_sample = Ms(Clock::now() - start);
+
+  CheckLimit("load to first sample", load_to_sample, kMaxLoadToFirstSampleMs);
+  CheckLimit("play to first sample", play_to_sample, kMaxPlayToFirstSampleMs);
+}
+
+TEST_F(PlayerHarness, SeekReachesFirstSample) {
+  int load = Call("load", LoadArgs({long_tone_}));
+  ASSERT_TRUE(PumpUntil([&]() { return Responded(load); }));
+  Call("play", fl_value_new_map());
+  ASSERT_TRUE(PumpUntil([&]() { return player_->position() > 0; }));
+
+  // Until the callback plays from the target, position() reports the
+  // target itself; anything past it was rendered from there.
+  double worst = 0;
+  for (int64_t target : {2500000, 500000, 3000000}) {
+    FlValue *args = fl_value_new_map();
+    fl_value_set_string_take(args, "position", fl_value_new_int(target));
+    Clock::time_point start = Clock::now();
+    Call("seek", args);
+    ASSERT_TRUE(PumpUntil([&]() { return player_->position() > target; }));
+    worst = std::max(worst, Ms(Clock::now() - start));
+  }
+
+  CheckLimit("seek to first sample", worst, kMaxSeekToFirstSampleMs);
+}
+
+TEST_F(PlayerHarness, CallbackPeriodJitter) {
+  int load = Call("load", LoadArgs({long_tone_}));
+  ASSERT_TRUE(PumpUntil([&]() { return Responded(load); }));
+  Call("play", fl_value_new_map());
+
+  AudioEngine &engine = AudioEngine::Instance();
+  CallbackProbe probe;
+  ASSERT_TRUE(engine.Attach(&probe));
+  Pump(std::chrono::seconds(2));
+  engine.Detach(&probe);
+
+  // Each interval should match the frames the previous callback covered.
+  std::vector<double> deviations;
+  for (size_t i = 1; i < probe.count(); ++i) {
+    double expected = 1000.0 * probe.frames(i - 1) / engine.sample_rate();
+    double actual = Ms(probe.time(i) - probe.time(i - 1));
+    deviations.push_back(std::fabs(actual - expected));
+  }
+  ASSERT_GT(deviations.size(), 10u);
+  std::sort(deviations.begin(), deviations.end());
+  double p99 = deviations[deviations.size() * 99 / 100];
+  double worst = deviations.back();
+
+  CheckLimit("callback jitter p99", p99, kMaxJitterP99Ms);
+  CheckLimit("callback jitter max", worst, kMaxJitterMs);
+}
+
+TEST_F(PlayerHarness, EventDeliveryLatency) {
+  int load = Call("load", LoadArgs({short_tone_, short_tone_}));
+  ASSERT_TRUE(PumpUntil([&]() { return Responded(load); }));
+  Clock::time_point start = Clock::now();
+  Call("play", fl_value_new_map());
+
+  // The moment the audio thread moves on, as seen from the main loop,
+  // against when the event for it reached the messenger.
+  Clock::time_point changed;
+  ASSERT_TRUE(PumpUntil([&]() { return player_->current_index_ == 1; }));
+  changed = Clock::now();
+  Clock::time_point delivered;
+  ASSERT_TRUE(PumpUntil([&]() {
+    return EventTime(
+        start, [](FlValue *e) { return IntField(e, "currentIndex") == 1; },
+        &delivered);
+  }));
+  double index_latency = std::max(0.0, Ms(delivered - changed));
+
+  ASSERT_TRUE(PumpUntil(
+      [&]() { return player_->state_ == PlayerState::COMPLETED; }));
+  changed = Clock::now();
+  ASSERT_TRUE(PumpUntil([&]() {
+    return EventTime(
+        start,
+        [](FlValue *e) {
+          return IntField(e, "processingState") ==
+                 (int64_t)PlayerState::COMPLETED;
+        },
+        &delivered);
+  }));
+  double completed_latency = std::max(0.0, Ms(delivered - changed));
+
+  CheckLimit("index change event", index_latency, kMaxEventDeliveryMs);
+  CheckLimit("completed event", completed_latency, kMaxEventDeliveryMs);
+}
+
+TEST_F(PlayerHarness, DisposeWhilePlaying) {
+  int load = Call("load", LoadArgs({long_tone_}));
+  ASSERT_TRUE(PumpUntil([&]() { return Responded(load); }));
+  Call("play", fl_value_new_map());
+  ASSERT_TRUE(PumpUntil([&]() { return player_->position() > 0; }));
+
+  // A load still in flight has to be answered, not leaked.
+  int pending = Call("load", LoadArgs({long_tone_}));
+  Clock::time_point start = Clock::now();
+  player_.reset();
+  double dispose = Ms(Clock::now() - start);
+  Pump(std::chrono::milliseconds(20));
+  ASSERT_TRUE(Responded(pending));
+  EXPECT_TRUE(recorder_.errors[pending]);
+  EXPECT_EQ(recorder_.error_codes[pending], "abort");
+
+  CheckLimit("dispose while playing", dispose, kMaxDisposeMs);
+}
+
+} // namespace
@@ -0,0 +1,237 @@
+#include "time_stretch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "dsp_kernels.h"
+
+namespace just_audio_windows_linux {
+
+// Segment, cross-fade and search window lengths. Around 40 ms segments keep
+// speech intelligible at 2x without audible echo; the search window covers
+// the pitch period of any voice.
+static constexpr ma_uint32 kSequenceMs = 40;
+static constexpr ma_uint32 kOverlapMs = 8;
+static constexpr ma_uint32 kSeekWindowMs = 15;
+
+// The search first tries every kCoarseStep-th offset, then every offset
+// around the best of those.
+static constexpr ma_uint32 kCoarseStep = 8;
+
+/* ---------------- setup ---------------- */
+
+void TimeStretch::Configure(ma_uint32 channels, ma_uint32 sample_rate) {
+  channels_ = channels;
+  sequence_ = std::max<ma_uint32>(kSequenceMs * sample_rate / 1000, 64);
+  overlap_ = std::max<ma_uint32>(kOverlapMs * sample_rate / 1000, 16);
+  seek_window_ = std::max<ma_uint32>(kSeekWindowMs * sample_rate / 1000, 16);
+
+  // Room for the next segment and its search window, plus as much again so
+  // input can arrive in whole decoder reads.
+  ma_uint32 capacity = 2 * (sequence_ + seek_window_);
+  input_.assign((size_t)capacity * channels_, 0.0f);
+  output_.assign((size_t)(capacity + overlap_) * channels_, 0.0f);
+  tail_.assign((size_t)overlap_ * channels_, 0.0f);
+  fade_.assign((size_t)overlap_ * channels_, 0.0f);
+  Reset(speed_);
+}
+
+void TimeStretch::Reset(double speed) {
+  speed_ = speed;
+  input_frames_ = 0;
+  input_base_ = 0;
+  input_total_ = 0;
+  position_ = 0;
+  finished_ = false;
+  flushed_ = false;
+  has_tail_ = false;
+  output_frames_ = 0;
+  output_read_ = 0;
+}
+
+/* ---------------- input ---------------- */
+
+ma_uint32 TimeStretch::input_space() const {
+  if (finished_) {
+    return 0;
+  }
+  return (ma_uint32)(input_.size() / channels_) - input_frames_;
+}
+
+void TimeStretch::Push(const float *input, ma_uint32 frames) {
+  // At high speed a segment can start past everything pushed so far; what
+  // comes before it is skipped on the way in.
+  if (input_total_ < input_base_) {
+    ma_uint32 skip =
+        (ma_uint32)std::min<ma_uint64>(frames, input_base_ - input_total_);
+    input += (size_t)skip * channels_;
+    frames -= skip;
+    input_total_ += skip;
+  }
+  frames = std::min(frames, input_space());
+  std::memcpy(&input_[(size_t)input_frames_ * channels_], input,
+              (size_t)frames * channels_ * sizeof(float));
+  input_frames_ += frames;
+  input_total_ += frames;
+}
+
+void TimeStretch::Finish() { finished_ = true; }
+
+void TimeStretch::Discard(ma_uint64 keep) {
+  ma_uint64 end = input_base_ + input_frames_;
+  if (keep >= end) {
+    input_frames_ = 0;
+    input_base_ = keep;
+    return;
+  }
+  ma_uint32 drop = (ma_uint32)(keep - input_base_);
+  std::memmove(input_.data(), &input_[(size_t)drop * channels_],
+               (size_t)(input_frames_ - drop) * channels_ * sizeof(float));
+  input_frames_ -= drop;
+  input_base_ = keep;
+}
+
+/* ---------------- output ---------------- */
+
+ma_uint32 TimeStretch::Pull(float *output, ma_uint32 frames, double *start,
+                            double *end) {
+  if (output_read_ == output_frames_) {
+    if (flushed_) {
+      return 0;
+    }
+    if (!Step()) {
+      if (!finished_) {
+        return 0;
+      }
+      Flush();
+    }
+  }
+
+  ma_uint32 count = std::min(frames, output_frames_ - output_read_);
+  std::memcpy(output, &output_[(size_t)output_read_ * channels_],
+              (size_t)count * channels_ * sizeof(float));
+  *start = output_start_ + output_read_ * output_speed_;
+  *end = *start + count * output_speed_;
+  output_read_ += count;
+  return count;
+}
+
+bool TimeStretch::Step() {
+  ma_uint64 start = (ma_uint64)position_;
+  if (input_base_ + input_frames_ < start + seek_window_ + sequence_) {
+    return false;
+  }
+
+  const float *window = &input_[(size_t)(start - input_base_) * channels_];
+  // At speed 1 the natural continuation is already the best fit.
+  ma_uint32 offset = has_tail_ && speed_ != 1.0 ? BestOffset(window) : 0;
+  const float *segment = window + (size_t)offset * channels_;
+
+  // Each step writes everything but the segment's last overlap_ frames,
+  // which are held back to fade into the next one.
+  ma_uint32 body = sequence_ - overlap_;
+  ma_uint32 copied = 0;
+  if (has_tail_) {
+    CrossFade(output_.data(), segment);
+    copied = overlap_;
+  }
+  std::memcpy(&output_[(size_t)copied * channels_],
+              segment + (size_t)copied * channels_,
+              (size_t)(body - copied) * channels_ * sizeof(float));
+  std::memcpy(tail_.data(), segment + (size_t)body * channels_,
+              tail_.size() * sizeof(float));
+  has_tail_ = true;
+
+  output_frames_ = body;
+  output_read_ = 0;
+  output_start_ = position_;
+  output_speed_ = speed_;
+
+  position_ += body * speed_;
+  Discard((ma_uint64)position_);
+  return true;
+}
+
+// The input left over is shorter than a segment and its search window, so
+// it is played as it is, faded in under the held-back tail.
+void TimeStretch::Flush() {
+  ma_uint64 start = std::max<ma_uint64>((ma_uint64)position_, input_base_);
+  ma_uint64 end = input_base_ + input_frames_;
+  ma_uint32 available = end > start ? (ma_uint32)(end - start) : 0;
+  const float *rest =
+      input_.data() +
+      (available > 0 ? (size_t)(start - input_base_) * channels_ : 0);
+
+  ma_uint32 frames = 0;
+  if (has_tail_ && available >= overlap_) {
+    CrossFade(output_.data(), rest);
+    std::memcpy(&output_[(size_t)overlap_ * channels_],
+                rest + (size_t)overlap_ * channels_,
+                (size_t)(available - overlap_) * channels_ * sizeof(float));
+    frames = available;
+  } else if (has_tail_) {
+    std::memcpy(output_.data(), tail_.data(), tail_.size() * sizeof(float));
+    frames = overlap_;
+  } else {
+    std::memcpy(output_.data(), rest,
+                (size_t)available * channels_ * sizeof(float));
+    frames = available;
+  }
+
+  output_frames_ = frames;
+  output_read_ = 0;
+  output_start_ = position_;
+  output_speed_ =
+      frames > 0 ? std::max(0.0, (input_total_ - position_) / frames) : 1.0;
+  flushed_ = true;
+}
+
+// Normalised cross-correlation of tail_ against each candidate position,
+// over all channels at once.
+ma_uint32 TimeStretch::BestOffset(const float *candidates) const {
+  const DspKernels &dsp = Dsp();
+  size_t samples = (size_t)overlap_ * channels_;
+  auto score = [&](ma_uint32 offset) {
+    const float *candidate = candidates + (size_t)offset * channels_;
+    float correlation = dsp.dot(tail_.data(), candidate, samples);
+    float energy = dsp.dot(candidate, candidate, samples);
+    return correlation / std::sqrt(energy + 1e-9f);
+  };
+
+  ma_uint32 best = 0;
+  float best_score = score(0);
+  for (ma_uint32 offset = kCoarseStep; offset <= seek_window_;
+       offset += kCoarseStep) {
+    float s = score(offset);
+    if (s > best_score) {
+      best = offset;
+      best_score = s;
+    }
+  }
+
+  ma_uint32 first = best > kCoarseStep ? best - kCoarseStep + 1 : 0;
+  ma_uint32 last = std::min(best + kCoarseStep - 1, seek_window_);
+  ma_uint32 coarse = best;
+  for (ma_uint32 offset = first; offset <= last; ++offset) {
+    if (offset == coarse) {
+      continue;
+    }
+    float s = score(offset);
+    if (s > best_score) {
+      best = offset;
+      best_score = s;
+    }
+  }
+  return best;
+}
+
+void TimeStretch::CrossFade(float *dst, const float *src) {
+  const DspKernels &dsp = Dsp();
+  float step = 1.0f / overlap_;
+  dsp.gain_ramp(dst, src, overlap_, channels_, 0.0f, step);
+  dsp.gain_ramp(fade_.data(), tail_.data(), overlap_, channels_, 1.0f, -step);
+  dsp.mix_add(dst, fade_.data(), (size_t)overlap_ * channels_, 1.0f);
+}
+
+} // namespace just_audio_windows_linux
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vector>
+
+#include "miniaudio.h"
+
+namespace just_audio_windows_linux {
+
+/* ---------------- TimeStretch ---------------- */
+
+// WSOLA time-stretch: changes the speed of interleaved f32 audio without
+// changing its pitch. Input is cut into overlapping segments that are read
+// `speed` times further apart than they are written; each segment is moved,
+// within a short search window, to where it best lines up with the tail of
+// the one before, and the two are cross-faded. Speed 1 reproduces the input.
+//
+// Decode thread only. Configure() allocates; nothing else does.
+class TimeStretch {
+public:
+  // Sizes the segments for this format and drops anything buffered.
+  void Configure(ma_uint32 channels, ma_uint32 sample_rate);
+
+  // Drops all input and output and starts over at input position 0.
+  void Reset(double speed);
+
+  // Takes effect from the next segment.
+  void set_speed(double speed) { speed_ = speed; }
+
+  // How many more input frames Push() takes right now.
+  ma_uint32 input_space() const;
+  void Push(const float *input, ma_uint32 frames);
+
+  // No more input is coming. What is left after the last whole segment
+  // is played out unstretched.
+  void Finish();
+
+  // Writes up to `frames` output frames and returns how many. start and end
+  // receive the input positions (frames pushed since Reset()) the written
+  // output corresponds to. Returns 0 when more input is needed, or once
+  // everything has been pulled after Finish().
+  ma_uint32 Pull(float *output, ma_uint32 frames, double *start, double *end);
+
+  // Finish() was called and every frame has been pulled.
+  bool drained() const {
+    return finished_ && flushed_ && output_read_ == output_frames_;
+  }
+
+private:
+  // Produces the next segment into output_; false if short of input.
+  bool Step();
+  void Flush();
+  // Offset into the search window where the segment lines up best with
+  // tail_.
+  ma_uint32 BestOffset(const float *candidates) const;
+  // dst = tail_ fading out plus src fading in, over overlap_ frames.
+  void CrossFade(float *dst, const float *src);
+  // Drops input before frame `keep`.
+  void Discard(ma_uint64 keep);
+
+  ma_uint32 channels_ = 0;
+  // Segment length, the part of it cross-faded with the previous one, and
+  // how far a segment may move to line up, in frames.
+  ma_uint32 sequence_ = 0;
+  ma_uint32 overlap_ = 0;
+  ma_uint32 seek_window_ = 0;
+  double speed_ = 1.0;
+
+  // Input not yet consumed; input_[0] is input frame input_base_.
+  std::vector<float> input_;
+  ma_uint32 input_frames_ = 0;
+  ma_uint64 input_base_ = 0;
+  ma_uint64 input_total_ = 0;
+  // Where the next segment nominally starts.
+  double position_ = 0;
+  bool finished_ = false;
+  bool flushed_ = false;
+
+  // The last overlap_ frames of the previous segment.
+  std::vector<float> tail_;
+  bool has_tail_ = false;
+  std::vector<float> fade_;
+
+  // The output of the last step; frame k of it corresponds to input
+  // position output_start_ + k * output_speed_.
+  std::vector<float> output_;
+  ma_uint32 output_frames_ = 0;
+  ma_uint32 output_read_ = 0;
+  double output_start_ = 0;
+  double output_speed_ = 1.0;
+};
+
+} // namespace just_audio_windows_linux
@@ -0,0 +1,538 @@
+#include "track.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/stat.h>
+
+#include "duration_probe.h"
+#include "miniaudio_libopus.h"
+#include "miniaudio_libvorbis.h"
+
+namespace just_audio_windows_linux {
+
+// Source frames pulled from the decoder per refill.
+static constexpr ma_uint32 kInputFrames = 2048;
+
+/* ---------------- stdio fallback ---------------- */
+
+// miniaudio's stdio file system, except that the first open hands back a
+// file the sniff already has open, rewound, so an unmapped file is opened
+// once for both. cb comes first, which makes a HandoffVfs* an ma_vfs*.
+struct HandoffVfs {
+  ma_vfs_callbacks cb;
+  ma_default_vfs base;
+  ma_vfs_file pending = nullptr;
+
+  HandoffVfs();
+  ~HandoffVfs() {
+    if (pending != nullptr) {
+      ma_vfs_close(&base, pending);
+    }
+  }
+
+  static ma_vfs *Base(ma_vfs *vfs) {
+    return &static_cast<HandoffVfs *>(vfs)->base;
+  }
+};
+
+HandoffVfs::HandoffVfs() {
+  ma_default_vfs_init(&base, nullptr);
+  cb = base.cb;
+  cb.onOpen = [](ma_vfs *vfs, const char *path, ma_uint32 mode,
+                 ma_vfs_file *file) {
+    HandoffVfs *self = static_cast<HandoffVfs *>(vfs);
+    if (self->pending != nullptr && mode == MA_OPEN_MODE_READ) {
+      *file = self->pending;
+      self->pending = nullptr;
+      return MA_SUCCESS;
+    }
+    return ma_vfs_open(&self->base, path, mode, file);
+  };
+  cb.onOpenW = [](ma_vfs *vfs, const wchar_t *path, ma_uint32 mode,
+                  ma_vfs_file *file) {
+    return ma_vfs_open_w(Base(vfs), path, mode, file);
+  };
+  cb.onClose = [](ma_vfs *vfs, ma_vfs_file file) {
+    return ma_vfs_close(Base(vfs), file);
+  };
+  cb.onRead = [](ma_vfs *vfs, ma_vfs_file file, void *dst, size_t size,
+                 size_t *read) {
+    return ma_vfs_read(Base(vfs), file, dst, size, read);
+  };
+  cb.onWrite = [](ma_vfs *vfs, ma_vfs_file file, const void *src, size_t size,
+                  size_t *written) {
+    return ma_vfs_write(Base(vfs), file, src, size, written);
+  };
+  cb.onSeek = [](ma_vfs *vfs, ma_vfs_file file, ma_int64 offset,
+                 ma_seek_origin origin) {
+    return ma_vfs_seek(Base(vfs), file, offset, origin);
+  };
+  cb.onTell = [](ma_vfs *vfs, ma_vfs_file file, ma_int64 *cursor) {
+    return ma_vfs_tell(Base(vfs), file, cursor);
+  };
+  cb.onInfo = [](ma_vfs *vfs, ma_vfs_file file, ma_file_info *info) {
+    return ma_vfs_info(Base(vfs), file, info);
+  };
+}
+
+// What the file looks like from its first bytes: straight from the mapping,
+// or read through vfs, which keeps the file open for the decoder.
+static AudioFormat sniff_file(const std::string &path, const MappedFile *file,
+                              HandoffVfs *vfs) {
+  if (file != nullptr) {
+    return SniffFormat(file->data(), file->size());
+  }
+  ma_vfs_file handle;
+  if (ma_vfs_open(&vfs->base, path.c_str(), MA_OPEN_MODE_READ, &handle) !=
+      MA_SUCCESS) {
+    return AudioFormat::kUnknown;
+  }
+  uint8_t head[kSniffBytes];
+  size_t size = 0;
+  ma_vfs_read(&vfs->base, handle, head, sizeof(head), &size);
+  if (ma_vfs_seek(&vfs->base, handle, 0, ma_seek_origin_start) ==
+      MA_SUCCESS) {
+    vfs->pending = handle;
+  } else {
+    ma_vfs_close(&vfs->base, handle);
+  }
+  return SniffFormat(head, size);
+}
+
+static ma_result init_decoder(const std::string &path, const MappedFile *file,
+                              HandoffVfs *vfs, const ma_decoder_config *config,
+                              ma_decoder *decoder) {
+  if (file != nullptr) {
+    return ma_decoder_init_memory(file->data(), file->size(), config, decoder);
+  }
+  return ma_decoder_init_vfs(vfs, path.c_str(), config, decoder);
+}
+
+/* ---------------- open / close ---------------- */
+
+// Modification time in nanoseconds, or -1 if the file cannot be stat'ed.
+static int64_t file_mtime(const std::string &path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    return -1;
+  }
+  return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+std::unique_ptr<Track> Track::Open(const std::string &path, ma_uint32 channels,
+                                   ma_uint32 outputRate, LoadTrace *trace) {
+  std::unique_ptr<Track> track(new Track());
+
+  PcmCache &cache = PcmCache::Instance();
+  int64_t mtime;
+  {
+    LoadTrace::Scope stage(trace, "cacheLookup");
+    mtime = file_mtime(path);
+    if (mtime >= 0) {
+      track->clip_ = cache.Find(path, mtime, channels);
+    }
+  }
+
+  if (track->clip_ == nullptr) {
+    if (!track->OpenDecoder(path, channels, trace)) {
+      return nullptr;
+    }
+    bool exact = false;
+    ma_uint64 frames;
+    {
+      LoadTrace::Scope stage(trace, "lengthProbe");
+      frames = track->EstimatedLengthInFrames(&exact);
+    }
+    if (mtime >= 0 && cache.Accepts(frames, track->sample_rate_,
+                                    track->channels_)) {
+      LoadTrace::Scope stage(trace, "clipDecode");
+      ma_uint64 max_frames =
+          cache.MaxClipFrames(track->sample_rate_, track->channels_);
+      if (!track->DecodeClip(frames, max_frames)) {
+        return nullptr;
+      }
+      if (track->clip_ != nullptr) {
+        cache.Insert(path, mtime, channels, track->clip_);
+      }
+    }
+  }
+
+  if (track->clip_ != nullptr) {
+    const PcmClip &clip = *track->clip_;
+    ma_audio_buffer_ref_init(ma_format_f32, clip.channels, clip.samples.data(),
+                             clip.frames, &track->clip_buffer_);
+    track->source_ = &track->clip_buffer_;
+    track->sample_rate_ = clip.sample_rate;
+    track->channels_ = clip.channels;
+    track->source_channels_ = clip.source_channels;
+    track->length_frames_ = clip.frames;
+  }
+
+  track->output_rate_ = outputRate != 0 ? outputRate : track->sample_rate_;
+  if (track->output_rate_ != track->sample_rate_) {
+    ma_resampler_config resampler_config = ma_resampler_config_init(
+        ma_format_f32, track->channels_, track->sample_rate_,
+        track->output_rate_,
+        ma_resample_algorithm_linear);
+
+    if (ma_resampler_init(&resampler_config, nullptr, &track->resampler_) !=
+        MA_SUCCESS) {
+      return nullptr;
+    }
+    track->resampling_ = true;
+  }
+
+  track->input_.assign((size_t)kInputFrames * track->channels_, 0.0f);
+  return track;
+}
+
+bool Track::OpenDecoder(const std::string &path, ma_uint32 channels,
+                        LoadTrace *trace) {
+  // Decoders read straight out of the mapping; if the file cannot be mapped
+  // they fall back to stdio.
+  {
+    LoadTrace::Scope stage(trace, "mapFile");
+    file_ = MappedFile::Open(path);
+  }
+
+  // Decode at the file's own rate; Open() reaches the output rate through an
+  // explicit resampler stage, only when the two differ.
+  ma_decoder_config decoder_config =
+      ma_decoder_config_init(ma_format_f32, channels, 0);
+
+  // The signature picks the one backend to initialise. A built-in one is
+  // named by encodingFormat; a custom one is the only vtable passed, and
+  // miniaudio tries custom backends first. Anything unrecognised gets every
+  // backend, custom ones first, in a single init.
+  ma_decoding_backend_vtable *custom_backends[] = {
+      ma_decoding_backend_libopus, ma_decoding_backend_libvorbis};
+  ma_uint32 custom_count = 0;
+  AudioFormat container;
+  {
+    LoadTrace::Scope stage(trace, "sniff");
+    if (file_ == nullptr) {
+      vfs_.reset(new HandoffVfs());
+    }
+    container = sniff_file(path, file_.get(), vfs_.get());
+  }
+  switch (container) {
+  case AudioFormat::kWav:
+    decoder_config.encodingFormat = ma_encoding_format_wav;
+    break;
+  case AudioFormat::kFlac:
+    decoder_config.encodingFormat = ma_encoding_format_flac;
+    break;
+  case AudioFormat::kMp3:
+    decoder_config.encodingFormat = ma_encoding_format_mp3;
+    break;
+  case AudioFormat::kOpus:
+    custom_count = 1;
+    break;
+  case AudioFormat::kVorbis:
+    custom_backends[0] = ma_decoding_backend_libvorbis;
+    custom_count = 1;
+    break;
+  case AudioFormat::kUnknown:
+    custom_count = 2;
+    break;
+  }
+  if (custom_count > 0) {
+    decoder_config.ppCustomBackendVTables = custom_backends;
+    decoder_config.customBackendCount = custom_count;
+  }
+
+  {
+    LoadTrace::Scope stage(trace, "decoderInit");
+    if (init_decoder(path, file_.get(), vfs_.get(), &decoder_config,
+                     &decoder_) != MA_SUCCESS) {
+      return false;
+    }
+  }
+  decoder_initialized_ = true;
+
+  source_ = &decoder_;
+  sample_rate_ = decoder_.outputSampleRate;
+  channels_ = decoder_.outputChannels;
+
+  ma_format format;
+  if (ma_data_source_get_data_format(decoder_.pBackend, &format,
+                                     &source_channels_, nullptr, nullptr,
+                                     0) != MA_SUCCESS) {
+    source_channels_ = channels_;
+  }
+
+  // A table from an earlier session makes seeks, and the length, free.
+  if (file_ != nullptr && ma_decoder_is_mp3(&decoder_)) {
+    LoadTrace::Scope stage(trace, "seekIndexLoad");
+    std::shared_ptr<const Mp3SeekIndex> index = Mp3SeekIndex::Load(*file_);
+    if (index != nullptr) {
+      BindSeekIndex(std::move(index));
+    }
+  }
+  return true;
+}
+
+bool Track::DecodeClip(ma_uint64 frames_hint, ma_uint64 max_frames) {
+  auto clip = std::make_shared<PcmClip>();
+  clip->channels = channels_;
+  clip->source_channels = source_channels_;
+  clip->sample_rate = decoder_.outputSampleRate;
+  clip->samples.resize((size_t)frames_hint * clip->channels);
+
+  // The reported length can be an estimate; grow if the decoder runs past
+  // it, but only up to one frame over what the cache keeps.
+  for (;;) {
+    if (clip->frames > max_frames) {
+      // Too long after all: stream it from the start like any other file.
+      if (Check(ma_decoder_seek_to_pcm_frame(&decoder_, 0)) != MA_SUCCESS) {
+        return false;
+      }
+      return true;
+    }
+    if (clip->frames * clip->channels == clip->samples.size()) {
+      clip->samples.resize(clip->samples.size() +
+                           (size_t)kInputFrames * clip->channels);
+    }
+    ma_uint64 capacity = clip->samples.size() / clip->channels - clip->frames;
+    capacity = std::min(capacity, max_frames + 1 - clip->frames);
+    ma_uint64 frames_read = 0;
+    ma_result result = Check(ma_decoder_read_pcm_frames(
+        &decoder_, clip->samples.data() + clip->frames * clip->channels,
+        capacity, &frames_read));
+    // A clip cut short by an error would be cached as the whole item.
+    if (result != MA_SUCCESS && result != MA_AT_END) {
+      return false;
+    }
+    clip->frames += frames_read;
+    if (frames_read == 0) {
+      break;
+    }
+  }
+
+  if (clip->frames == 0) {
+    return false;
+  }
+  clip->samples.resize((size_t)clip->frames * clip->channels);
+  clip->samples.shrink_to_fit();
+
+  ma_decoder_uninit(&decoder_);
+  decoder_initialized_ = false;
+  file_.reset();
+  vfs_.reset();
+  clip_ = std::move(clip);
+  return true;
+}
+
+Track::~Track() {
+  if (resampling_) {
+    ma_resampler_uninit(&resampler_, nullptr);
+  }
+  if (decoder_initialized_) {
+    ma_decoder_uninit(&decoder_);
+  }
+}
+
+/* ---------------- decoding ---------------- */
+
+ma_result Track::Check(ma_result result) {
+  if (result != MA_SUCCESS && result != MA_AT_END) {
+    ++decode_errors_;
+  }
+  return result;
+}
+
+bool Track::Fill() {
+  ma_uint64 frames_read = 0;
+  Check(ma_data_source_read_pcm_frames(source_, input_.data(), kInputFrames,
+                                       &frames_read));
+  input_offset_ = 0;
+  input_frames_ = (ma_uint32)frames_read;
+  return frames_read > 0;
+}
+
+ma_uint32 Track::Read(float *output, ma_uint32 frameCount,
+                      ma_uint64 *sourceFrames, bool *atEnd) {
+  *sourceFrames = 0;
+  *atEnd = false;
+
+  // Back to linear playback after a jump.
+  if (seeking_) {
+    file_->AdviseSequential();
+    seeking_ = false;
+  }
+
+  ma_uint32 channels = channels_;
+  ma_uint32 produced = 0;
+
+  while (produced < frameCount) {
+    // Nothing buffered and nothing to convert: decode straight into output.
+    if (input_frames_ == 0 && !resampling_) {
+      ma_uint64 frames_read = 0;
+      Check(ma_data_source_read_pcm_frames(source_,
+                                           output + produced * channels,
+                                           frameCount - produced,
+                                           &frames_read));
+      produced += (ma_uint32)frames_read;
+      *sourceFrames += frames_read;
+      *atEnd = frames_read == 0;
+      break;
+    }
+
+    if (input_frames_ == 0 && !Fill()) {
+      *atEnd = true;
+      break;
+    }
+
+    const float *input = input_.data() + input_offset_ * channels;
+    ma_uint64 frames_in = input_frames_;
+    ma_uint64 frames_out = frameCount - produced;
+
+    if (resampling_) {
+      ma_resampler_process_pcm_frames(&resampler_, input, &frames_in,
+                                      output + produced * channels,
+                                      &frames_out);
+    } else {
+      frames_in = frames_out = std::min(frames_in, frames_out);
+      std::memcpy(output + produced * channels, input,
+                  frames_in * channels * sizeof(float));
+    }
+
+    input_offset_ += (ma_uint32)frames_in;
+    input_frames_ -= (ma_uint32)frames_in;
+    produced += (ma_uint32)frames_out;
+    *sourceFrames += frames_in;
+
+    if (frames_in == 0 && frames_out == 0) {
+      break;
+    }
+  }
+
+  return produced;
+}
+
+bool Track::SetVarispeed(double speed) {
+  if (speed == varispeed_) {
+    return true;
+  }
+
+  if (!resampling_) {
+    ma_resampler_config resampler_config = ma_resampler_config_init(
+        ma_format_f32, channels_, sample_rate_, output_rate_,
+        ma_resample_algorithm_linear);
+    if (ma_resampler_init(&resampler_config, nullptr, &resampler_) !=
+        MA_SUCCESS) {
+      return false;
+    }
+    resampling_ = true;
+  }
+
+  // Taking speed times as many input frames per output frame; the
+  // resampler keeps its phase and filter state across the change. The rates
+  // are passed as integers: set_rate_ratio() would round the ratio to
+  // thousandths, and 1.0 has to get back to exactly the original rates.
+  ma_uint32 in_rate = sample_rate_;
+  if (speed != 1.0) {
+    in_rate = (ma_uint32)std::max(1.0, std::round(sample_rate_ * speed));
+  }
+  if (ma_resampler_set_rate(&resampler_, in_rate, output_rate_) !=
+      MA_SUCCESS) {
+    return false;
+  }
+  varispeed_ = speed;
+  return true;
+}
+
+// Bytes requested around a seek target, centred on the estimated offset.
+static constexpr size_t kSeekWindowBytes = 256 * 1024;
+
+ma_result Track::Seek(ma_uint64 frame) {
+  if (resampling_) {
+    ma_resampler_reset(&resampler_);
+  }
+  input_offset_ = 0;
+  input_frames_ = 0;
+
+  if (file_ != nullptr) {
+    // Readahead from the old position is wasted now. Fault in a window
+    // around where the target most likely sits, assuming a roughly constant
+    // bitrate; decoders that scan from the start still get the random hint.
+    file_->AdviseRandom();
+    seeking_ = true;
+    ma_uint64 length = length_frames_ > 0 ? length_frames_ : estimated_frames_;
+    if (length > 0) {
+      size_t estimate = (size_t)((double)frame / (double)length *
+                                 (double)file_->size());
+      size_t start =
+          estimate > kSeekWindowBytes / 2 ? estimate - kSeekWindowBytes / 2 : 0;
+      file_->WillNeed(start, kSeekWindowBytes);
+    }
+  }
+
+  return Check(ma_data_source_seek_to_pcm_frame(source_, frame));
+}
+
+void Track::Preroll() {
+  if (input_frames_ == 0) {
+    Fill();
+  }
+}
+
+/* ---------------- MP3 seek index ---------------- */
+
+bool Track::wants_seek_index() const {
+  return file_ != nullptr && decoder_initialized_ && seek_index_ == nullptr &&
+         ma_decoder_is_mp3(&decoder_);
+}
+
+void Track::BindSeekIndex(std::shared_ptr<const Mp3SeekIndex> index) {
+  if (!wants_seek_index()) {
+    return;
+  }
+  if (ma_decoder_bind_mp3_seek_table(&decoder_,
+                                     (ma_uint32)index->points().size(),
+                                     index->points().data()) != MA_SUCCESS) {
+    return;
+  }
+  seek_index_ = std::move(index);
+  length_frames_ = seek_index_->total_frames();
+}
+
+/* ---------------- length ---------------- */
+
+ma_uint64 Track::EstimatedLengthInFrames(bool *exact) {
+  *exact = true;
+  if (length_frames_ > 0) {
+    return length_frames_;
+  }
+
+  DurationProbe probe;
+  if (file_ == nullptr ||
+      !ProbeDuration(file_->data(), file_->size(), &probe)) {
+    // Nothing to go on but the decoder; cheap for WAV, a scan for MP3.
+    return LengthInFrames();
+  }
+
+  ma_uint64 frames = probe.frames;
+  if (probe.sample_rate != sample_rate_) {
+    frames = frames * sample_rate_ / probe.sample_rate;
+  }
+  if (probe.exact) {
+    length_frames_ = frames;
+  } else {
+    estimated_frames_ = frames;
+    *exact = false;
+  }
+  return frames;
+}
+
+ma_uint64 Track::LengthInFrames() {
+  if (length_frames_ == 0) {
+    ma_data_source_get_length_in_pcm_frames(source_, &length_frames_);
+  }
+  return length_frames_;
+}
+
+} // namespace just_audio_windows_linux
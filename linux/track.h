@@ -0,0 +1,140 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "load_trace.h"
+#include "mapped_file.h"
+#include "miniaudio.h"
+#include "mp3_seek_index.h"
+#include "pcm_cache.h"
+
+namespace just_audio_windows_linux {
+
+struct HandoffVfs;
+
+/* ---------------- Track ---------------- */
+
+// One playlist item as the decode thread sees it: a decoder running at the
+// file's own rate, followed by a resampler to the engine rate when the two
+// differ; opened natively, neither rate nor channels are converted. Local
+// files are decoded out of an mmap where possible; short clips are decoded
+// once into the PcmCache and replayed from RAM without a decoder, and MP3s
+// seek through an Mp3SeekIndex once one is bound. Not thread safe; the
+// owner serialises access.
+class Track {
+public:
+  ~Track();
+
+  Track(const Track &) = delete;
+  Track &operator=(const Track &) = delete;
+
+  // Opens path for f32 output with `channels` channels at `outputRate`.
+  // Zero for either keeps the file's own. Returns nullptr if no decoder
+  // accepts the file. trace, if given, gets a span for each step.
+  static std::unique_ptr<Track> Open(const std::string &path,
+                                     ma_uint32 channels, ma_uint32 outputRate,
+                                     LoadTrace *trace = nullptr);
+
+  // Produces up to frameCount output frames. sourceFrames receives how many
+  // decoder frames they were made from; atEnd is set once the decoder has
+  // nothing left.
+  ma_uint32 Read(float *output, ma_uint32 frameCount, ma_uint64 *sourceFrames,
+                 bool *atEnd);
+
+  // Moves to a source frame and drops anything buffered. With a mapped file
+  // the pages around the target are requested before the decoder gets there.
+  ma_result Seek(ma_uint64 frame);
+
+  // Decodes the first chunk ahead of time so the handover from the previous
+  // item does not pay for it.
+  void Preroll();
+
+  // Plays `speed` times faster by resampling, pitch moving along with it.
+  // The first call on a track with no resampler creates one; Read() keeps
+  // reporting the source frames consumed, so positions stay right.
+  bool SetVarispeed(double speed);
+
+  // Full length in source frames. May scan the whole file the first time.
+  ma_uint64 LengthInFrames();
+
+  // Length from container headers where they have it, without decoding.
+  // exact is cleared when the figure still wants confirming by
+  // LengthInFrames(); otherwise this is the same as calling it.
+  ma_uint64 EstimatedLengthInFrames(bool *exact);
+
+  // True for a mapped MP3 still seeking without a table. Building one is
+  // left to the owner because it scans the whole file.
+  bool wants_seek_index() const;
+  void BindSeekIndex(std::shared_ptr<const Mp3SeekIndex> index);
+  const MappedFile *file() const { return file_.get(); }
+
+  // Decoder reads and seeks that failed for a reason other than running
+  // out of data since the last call, and starts counting again.
+  ma_uint32 take_decode_errors() {
+    ma_uint32 errors = decode_errors_;
+    decode_errors_ = 0;
+    return errors;
+  }
+
+  ma_uint32 sample_rate() const { return sample_rate_; }
+  // Rate of what Read() produces.
+  ma_uint32 output_rate() const { return output_rate_; }
+  ma_uint32 channels() const { return channels_; }
+  bool resampling() const { return resampling_; }
+  // Whether the decoder mixes the file's channels to channels().
+  bool remixing() const { return source_channels_ != channels_; }
+  bool mapped() const { return file_ != nullptr; }
+  bool cached() const { return clip_ != nullptr; }
+
+private:
+  Track() = default;
+
+  bool OpenDecoder(const std::string &path, ma_uint32 channels,
+                   LoadTrace *trace);
+  // Decodes the whole file into clip_ and releases the decoder. A file longer
+  // than max_frames after all is left to stream: the decoder is rewound and
+  // clip_ stays empty. Fails on any decode error, caching nothing.
+  bool DecodeClip(ma_uint64 frames_hint, ma_uint64 max_frames);
+  bool Fill();
+  // Counts result towards take_decode_errors() and passes it on.
+  ma_result Check(ma_result result);
+
+  // Backing store of decoder_ when the file could be mapped; otherwise the
+  // stdio file system decoder_ reads through.
+  std::shared_ptr<MappedFile> file_;
+  std::unique_ptr<HandoffVfs> vfs_;
+  // Set by Seek() until reading resumes, while the mapping is advised random.
+  bool seeking_ = false;
+  ma_uint32 decode_errors_ = 0;
+  ma_uint64 length_frames_ = 0;
+  ma_uint64 estimated_frames_ = 0;
+
+  ma_decoder decoder_;
+  bool decoder_initialized_ = false;
+  // Bound into decoder_, so it has to stay alive as long as the decoder.
+  std::shared_ptr<const Mp3SeekIndex> seek_index_;
+
+  // Replaces the decoder when the file is held in the cache.
+  std::shared_ptr<const PcmClip> clip_;
+  ma_audio_buffer_ref clip_buffer_;
+
+  // Whichever of the two above is live.
+  ma_data_source *source_ = nullptr;
+  ma_uint32 sample_rate_ = 0;
+  ma_uint32 output_rate_ = 0;
+  ma_uint32 channels_ = 0;
+  ma_uint32 source_channels_ = 0;
+
+  ma_resampler resampler_;
+  bool resampling_ = false;
+  double varispeed_ = 1.0;
+
+  // Source-rate frames decoded but not yet handed to the output.
+  std::vector<float> input_;
+  ma_uint32 input_offset_ = 0;
+  ma_uint32 input_frames_ = 0;
+};
+
+} // namespace just_audio_windows_linux
@@ -45,6 +45,10 @@ std::wstring DecodeUrlToWstring(const std::string &encoded) {
   return wstr;
 }
 
+// Posted by the device thread when the decoder runs dry.
+constexpr UINT kCompletedMessage = WM_APP + 1;
+constexpr wchar_t kWindowClass[] = L"JustAudioWindowsLinuxPlayer";
+
 const flutter::EncodableValue *getValue(const flutter::EncodableMap *map,
                                         const char *key) {
   auto it = map->find(flutter::EncodableValue(key));
@@ -56,6 +60,19 @@ const flutter::EncodableValue *getValue(const flutter::EncodableMap *map,
 
 AudioPlayer::AudioPlayer(std::string id, flutter::BinaryMessenger *messenger)
     : id_(id) {
+  static bool class_registered = false;
+  if (!class_registered) {
+    WNDCLASSEXW window_class{};
+    window_class.cbSize = sizeof(window_class);
+    window_class.lpfnWndProc = AudioPlayer::WindowProc;
+    window_class.hInstance = GetModuleHandle(nullptr);
+    window_class.lpszClassName = kWindowClass;
+    RegisterClassExW(&window_class);
+    class_registered = true;
+  }
+  window_ = CreateWindowExW(0, kWindowClass, L"", 0, 0, 0, 0, 0, HWND_MESSAGE,
+                            nullptr, GetModuleHandle(nullptr), nullptr);
+  SetWindowLongPtr(window_, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(this));
 
   player_channel_ =
       std::make_unique<flutter::MethodChannel<flutter::EncodableValue>>(
@@ -117,6 +134,23 @@ AudioPlayer::~AudioPlayer() {
     ma_device_uninit(&device_);
     ma_decoder_uninit(&decoder_);
   }
+  // A completion still queued is dropped along with the window.
+  if (window_ != nullptr) {
+    DestroyWindow(window_);
+  }
+}
+
+LRESULT CALLBACK AudioPlayer::WindowProc(HWND window, UINT message,
+                                         WPARAM wparam, LPARAM lparam) {
+  if (message == kCompletedMessage) {
+    auto *self = reinterpret_cast<AudioPlayer *>(
+        GetWindowLongPtr(window, GWLP_USERDATA));
+    if (self != nullptr) {
+      self->sendPlaybackEvent();
+    }
+    return 0;
+  }
+  return DefWindowProc(window, message, wparam, lparam);
 }
 
 bool AudioPlayer::load(std::string uri) {
@@ -273,52 +307,67 @@ void AudioPlayer::DataCallback(ma_device *device, void *output, const void *,
     std::memset(samples + frames_read * channels, 0,
                 (frameCount - frames_read) * channels * sizeof(float));
     self->state_ = PlayerState::COMPLETED;
-    self->sendPlaybackEvent();
+    // Sending from here would copy into the sink and take its locks on the
+    // device thread; the platform thread sends the event instead.
+    PostMessage(self->window_, kCompletedMessage, 0, 0);
   }
 }
 
+// Keys are built once; the maps below reuse them and their nodes, so a
+// steady stream of events only assigns values.
+static const flutter::EncodableValue kProcessingStateKey("processingState");
+static const flutter::EncodableValue kUpdatePositionKey("updatePosition");
+static const flutter::EncodableValue kBufferedPositionKey("bufferedPosition");
+static const flutter::EncodableValue kDurationKey("duration");
+static const flutter::EncodableValue kUpdateTimeKey("updateTime");
+static const flutter::EncodableValue kCurrentIndexKey("currentIndex");
+static const flutter::EncodableValue kPlayingKey("playing");
+static const flutter::EncodableValue kVolumeKey("volume");
+static const flutter::EncodableValue kSpeedKey("speed");
+static const flutter::EncodableValue kLoopModeKey("loopMode");
+static const flutter::EncodableValue kShuffleModeKey("shuffleMode");
+
 void AudioPlayer::sendPlaybackEvent() {
-  auto eventData = flutter::EncodableMap();
+  if (!event_sink_) {
+    return;
+  }
+  auto &eventData = std::get<flutter::EncodableMap>(event_value_);
 
-  eventData[flutter::EncodableValue("processingState")] =
-      flutter::EncodableValue((int)state_);
+  eventData[kProcessingStateKey] =
+      flutter::EncodableValue((int)state_.load());
 
-  eventData[flutter::EncodableValue("updatePosition")] =
-      flutter::EncodableValue(position()); // int
+  eventData[kUpdatePositionKey] = flutter::EncodableValue(position()); // int
 
-  eventData[flutter::EncodableValue("bufferedPosition")] =
-      flutter::EncodableValue(duration_); // int
-  eventData[flutter::EncodableValue("duration")] =
-      flutter::EncodableValue(duration_); // int
+  eventData[kBufferedPositionKey] = flutter::EncodableValue(duration_); // int
+  eventData[kDurationKey] = flutter::EncodableValue(duration_);         // int
   auto now = std::chrono::system_clock::now();
 
-  eventData[flutter::EncodableValue("updateTime")] = flutter::EncodableValue(
+  eventData[kUpdateTimeKey] = flutter::EncodableValue(
       std::chrono::duration_cast<std::chrono::milliseconds>(
           now.time_since_epoch())
           .count()); // int
 
   // I don't care about the following data
-  eventData[flutter::EncodableValue("currentIndex")] =
-      flutter::EncodableValue(0); // int
+  eventData[kCurrentIndexKey] = flutter::EncodableValue(0); // int
 
-  event_sink_->Success(eventData);
+  event_sink_->Success(event_value_);
 }
 
 void AudioPlayer::sendPlaybackData() {
-  auto eventData = flutter::EncodableMap();
+  if (!data_sink_) {
+    return;
+  }
+  auto &eventData = std::get<flutter::EncodableMap>(data_value_);
 
-  eventData[flutter::EncodableValue("playing")] =
-      flutter::EncodableValue(playing_);
-  eventData[flutter::EncodableValue("volume")] =
-      flutter::EncodableValue(volume_.load());
-  eventData[flutter::EncodableValue("speed")] = flutter::EncodableValue(speed_);
+  eventData[kPlayingKey] = flutter::EncodableValue(playing_);
+  eventData[kVolumeKey] = flutter::EncodableValue(volume_.load());
+  eventData[kSpeedKey] = flutter::EncodableValue(speed_);
 
   // I don't care about the following data
-  eventData[flutter::EncodableValue("loopMode")] = flutter::EncodableValue(0);
-  eventData[flutter::EncodableValue("shuffleMode")] =
-      flutter::EncodableValue(0);
+  eventData[kLoopModeKey] = flutter::EncodableValue(0);
+  eventData[kShuffleModeKey] = flutter::EncodableValue(0);
 
-  data_sink_->Success(eventData);
+  data_sink_->Success(data_value_);
 }
 
 void AudioPlayer::HandleMethodCall(
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <windows.h>
+
 #include <flutter/event_channel.h>
 #include <flutter/event_stream_handler_functions.h>
 #include <flutter/method_channel.h>
@@ -24,6 +26,16 @@ private:
       player_channel_;
   std::unique_ptr<flutter::EventSink<>> event_sink_ = nullptr;
   std::unique_ptr<flutter::EventSink<>> data_sink_ = nullptr;
+  // Reused by every event so only the values are assigned each time, and
+  // handed to the sinks by reference. Only touched on the platform thread.
+  flutter::EncodableValue event_value_{flutter::EncodableMap()};
+  flutter::EncodableValue data_value_{flutter::EncodableMap()};
+
+  // Message-only window on the platform thread. The device thread posts
+  // completion to it instead of sending the event itself.
+  HWND window_ = nullptr;
+  static LRESULT CALLBACK WindowProc(HWND window, UINT message, WPARAM wparam,
+                                     LPARAM lparam);
 
   ma_context context_;
   ma_decoder decoder_{};
@@ -31,7 +43,7 @@ private:
   std::atomic<ma_uint64> current_frame_{0};
   ma_uint64 seek_frame_{0};
   bool need_seek_ = false;
-  PlayerState state_{PlayerState::IDLE};
+  std::atomic<PlayerState> state_{PlayerState::IDLE};
   std::atomic<double> volume_{1.0};
   double speed_ = 1.0;
   bool initialized_ = false;
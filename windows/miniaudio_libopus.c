@@ -210,6 +210,41 @@ MA_API ma_result ma_libopus_init_file(const char* pFilePath, const ma_decoding_b
     #endif
 }
 
+MA_API ma_result ma_libopus_init_memory(const void* pData, size_t dataSize, const ma_decoding_backend_config* pConfig, const ma_allocation_callbacks* pAllocationCallbacks, ma_libopus* pOpus)
+{
+    ma_result result;
+
+    (void)pAllocationCallbacks; /* Can't seem to find a way to configure memory allocations in libopus. */
+
+    if (pData == NULL || dataSize == 0) {
+        return MA_INVALID_ARGS;
+    }
+
+    result = ma_libopus_init_internal(pConfig, pOpus);
+    if (result != MA_SUCCESS) {
+        return result;
+    }
+
+    #if !defined(MA_NO_LIBOPUS)
+    {
+        int libopusResult;
+
+        /* opusfile reads straight out of the buffer, so it must outlive the decoder. */
+        pOpus->of = op_open_memory((const unsigned char*)pData, dataSize, &libopusResult);
+        if (pOpus->of == NULL) {
+            return MA_INVALID_FILE;
+        }
+
+        return MA_SUCCESS;
+    }
+    #else
+    {
+        /* libopus is disabled. */
+        return MA_NOT_IMPLEMENTED;
+    }
+    #endif
+}
+
 MA_API void ma_libopus_uninit(ma_libopus* pOpus, const ma_allocation_callbacks* pAllocationCallbacks)
 {
     if (pOpus == NULL) {
@@ -510,6 +545,29 @@ static ma_result ma_decoding_backend_init_file__libopus(void* pUserData, const c
     return MA_SUCCESS;
 }
 
+static ma_result ma_decoding_backend_init_memory__libopus(void* pUserData, const void* pData, size_t dataSize, const ma_decoding_backend_config* pConfig, const ma_allocation_callbacks* pAllocationCallbacks, ma_data_source** ppBackend)
+{
+    ma_result result;
+    ma_libopus* pOpus;
+
+    (void)pUserData;
+
+    pOpus = (ma_libopus*)ma_malloc(sizeof(*pOpus), pAllocationCallbacks);
+    if (pOpus == NULL) {
+        return MA_OUT_OF_MEMORY;
+    }
+
+    result = ma_libopus_init_memory(pData, dataSize, pConfig, pAllocationCallbacks, pOpus);
+    if (result != MA_SUCCESS) {
+        ma_free(pOpus, pAllocationCallbacks);
+        return result;
+    }
+
+    *ppBackend = pOpus;
+
+    return MA_SUCCESS;
+}
+
 static void ma_decoding_backend_uninit__libopus(void* pUserData, ma_data_source* pBackend, const ma_allocation_callbacks* pAllocationCallbacks)
 {
     ma_libopus* pOpus = (ma_libopus*)pBackend;
@@ -525,7 +583,7 @@ static ma_decoding_backend_vtable ma_gDecodingBackendVTable_libopus =
     ma_decoding_backend_init__libopus,
     ma_decoding_backend_init_file__libopus,
     NULL, /* onInitFileW() */
-    NULL, /* onInitMemory() */
+    ma_decoding_backend_init_memory__libopus,
     ma_decoding_backend_uninit__libopus
 };
 ma_decoding_backend_vtable* ma_decoding_backend_libopus = &ma_gDecodingBackendVTable_libopus;